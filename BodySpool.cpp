@@ -0,0 +1,218 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "BodySpool.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+
+// size of the chunks read from the body
+static const int chunkSize = 64 * 1024;
+
+////////////////////////////////////////////////////////////
+/// memory used by the spooled bodies of the whole process
+////////////////////////////////////////////////////////////
+struct SpoolState
+{
+	SpoolState() : budget( 64 * 1024 * 1024 ), used( 0 ), inMemory( 0 ), spilled( 0 ), spilledBytes( 0 ) {}
+	
+	QMutex mutex;
+	qint64 budget;
+	qint64 used;
+	qint64 inMemory;
+	qint64 spilled;
+	qint64 spilledBytes;
+};
+
+Q_GLOBAL_STATIC( SpoolState, spoolState )
+
+////////////////////////////////////////////////////////////
+/// a body kept in memory, giving its memory back to the process budget when it is destroyed
+////////////////////////////////////////////////////////////
+class SpoolBuffer : public QBuffer
+{
+public:
+	SpoolBuffer( const QByteArray & data, qint64 reserved ) : m_reserved( reserved )
+	{
+		setData( data );
+	}
+	
+	~SpoolBuffer()
+	{
+		BodySpool::release( m_reserved );
+	}
+
+private:
+	qint64 m_reserved;
+};
+
+////////////////////////////////////////////////////////////
+/// read a body entirely
+////////////////////////////////////////////////////////////
+QIODevice * BodySpool::spool( QIODevice * body, qint64 budget, qint64 & length )
+{
+	QByteArray memory;
+	qint64 reserved = 0;
+	QTemporaryFile * file = 0;
+	bool canSpill = true;
+	length = 0;
+	
+	QByteArray chunk( chunkSize, Qt::Uninitialized );
+	for(;;)
+	{
+		// the body can't wait for more data, so nothing read means its end, unless it failed
+		qint64 read = body->read( chunk.data(), chunk.size() );
+		if( read < 0 && !body->atEnd() )
+		{
+			qWarning( "SendForm: cannot read the body to spool it (%s)", qPrintable( body->errorString() ) );
+			release( reserved );
+			delete file;
+			return 0;
+		}
+		if( read <= 0 ) break;
+		
+		length += read;
+		
+		if( !file )
+		{
+			bool fits = budget < 0 || memory.size() + read <= budget;
+			if( fits && reserve( read ) )
+			{
+				reserved += read;
+			}
+			else if( canSpill )
+			{
+				file = new QTemporaryFile;
+				if( file->open() && file->write( memory ) == memory.size() )
+				{
+					memory.clear();
+					release( reserved );
+					reserved = 0;
+				}
+				else
+				{
+					// better use too much memory than fail the request
+					qWarning( "SendForm: cannot write a temporary file to spool the body, it is kept in memory" );
+					delete file;
+					file = 0;
+					canSpill = false;
+				}
+			}
+		}
+		
+		if( !file )
+		{
+			memory.append( chunk.constData(), int( read ) );
+		}
+		else if( file->write( chunk.constData(), read ) != read )
+		{
+			// the beginning of the body is already in the file, there is nothing to fall back on
+			qWarning( "SendForm: cannot write the spooled body to a temporary file (%s)", qPrintable( file->errorString() ) );
+			delete file;
+			return 0;
+		}
+	}
+	
+	// the last writes are only flushed when seeking
+	if( file && !file->seek( 0 ) )
+	{
+		qWarning( "SendForm: cannot write the spooled body to a temporary file (%s)", qPrintable( file->errorString() ) );
+		delete file;
+		return 0;
+	}
+	
+	QMutexLocker locker( &spoolState()->mutex );
+	if( file )
+	{
+		spoolState()->spilled++;
+		spoolState()->spilledBytes += length;
+		locker.unlock();
+		
+		return file;
+	}
+	
+	spoolState()->inMemory++;
+	locker.unlock();
+	
+	SpoolBuffer * buffer = new SpoolBuffer( memory, reserved );
+	buffer->open( QIODevice::ReadOnly );
+	return buffer;
+}
+
+////////////////////////////////////////////////////////////
+/// set the number of bytes all the spooled bodies can keep in memory
+////////////////////////////////////////////////////////////
+void BodySpool::setProcessBudget( qint64 bytes )
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	spoolState()->budget = bytes;
+}
+
+qint64 BodySpool::processBudget()
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	return spoolState()->budget;
+}
+
+qint64 BodySpool::memoryUsed()
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	return spoolState()->used;
+}
+
+qint64 BodySpool::inMemoryCount()
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	return spoolState()->inMemory;
+}
+
+qint64 BodySpool::spilledCount()
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	return spoolState()->spilled;
+}
+
+qint64 BodySpool::spilledBytes()
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	return spoolState()->spilledBytes;
+}
+
+////////////////////////////////////////////////////////////
+/// take some memory from the process budget
+////////////////////////////////////////////////////////////
+bool BodySpool::reserve( qint64 bytes )
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	
+	if( spoolState()->budget >= 0 && spoolState()->used + bytes > spoolState()->budget ) return false;
+	
+	spoolState()->used += bytes;
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// give some memory back to the process budget
+////////////////////////////////////////////////////////////
+void BodySpool::release( qint64 bytes )
+{
+	QMutexLocker locker( &spoolState()->mutex );
+	spoolState()->used -= bytes;
+}
@@ -0,0 +1,89 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_BODY_SPOOL
+#define SEND_FORM_BODY_SPOOL
+
+#include <QIODevice>
+
+////////////////////////////////////////////////////////////
+/// BodySpool reads a body of unknown length entirely, so it can be sent with its length.
+///
+/// The body is kept in memory while it fits in the budget of its form and in the budget
+/// shared by the whole process, the rest is spilled to a temporary file.
+////////////////////////////////////////////////////////////
+class BodySpool
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// read a body entirely
+	///
+	/// \param body : the opened body, it must give all its data without waiting for the event loop
+	/// \param budget : the number of bytes that can be kept in memory (negative for no limit besides the process one)
+	/// \param length : receives the size of the body
+	///
+	/// \return an opened random-access device containing the body, the caller takes its ownership,
+	/// or 0 if the body couldn't be read or written to the temporary file
+	///
+	/// \remarks a read returning -1 before the end of the body (atEnd() is false) is a read error,
+	/// the body isn't sent truncated
+	///
+	////////////////////////////////////////////////////////////
+	static QIODevice * spool( QIODevice * body, qint64 budget, qint64 & length );
+	
+	////////////////////////////////////////////////////////////
+	/// set the number of bytes all the spooled bodies can keep in memory
+	///
+	/// \param bytes : the budget (64 MiB by default), negative for no limit
+	///
+	////////////////////////////////////////////////////////////
+	static void setProcessBudget( qint64 bytes );
+	
+	static qint64 processBudget();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes kept in memory by the spooled bodies still alive
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 memoryUsed();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bodies kept entirely in memory
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 inMemoryCount();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bodies spilled to a temporary file
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 spilledCount();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes written to temporary files
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 spilledBytes();
+
+private:
+	friend class SpoolBuffer;
+	
+	static bool reserve( qint64 bytes );
+	static void release( qint64 bytes );
+};
+
+#endif
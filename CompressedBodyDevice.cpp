@@ -0,0 +1,178 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "CompressedBodyDevice.h"
+
+#include <zlib.h>
+
+// size of the buffer the source is read into
+static const int inputSize = 64 * 1024;
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+CompressedBodyDevice::CompressedBodyDevice( QIODevice * source, int level, Format format, QObject * parent ) : QIODevice( parent )
+{
+	m_source = source;
+	m_level = level;
+	m_format = format;
+	m_stream = 0;
+	m_sourceEnd = false;
+	m_finished = false;
+	
+	connect( source, SIGNAL( readyRead() ), this, SIGNAL( readyRead() ) );
+}
+
+////////////////////////////////////////////////////////////
+/// Destructor
+////////////////////////////////////////////////////////////
+CompressedBodyDevice::~CompressedBodyDevice()
+{
+	close();
+}
+
+////////////////////////////////////////////////////////////
+/// get the value of the "Content-Encoding" header matching the format
+////////////////////////////////////////////////////////////
+QByteArray CompressedBodyDevice::contentEncoding() const
+{
+	return m_format == Gzip ? "gzip" : "deflate";
+}
+
+////////////////////////////////////////////////////////////
+/// start a new compression stream
+////////////////////////////////////////////////////////////
+bool CompressedBodyDevice::open( OpenMode mode )
+{
+	if( mode & QIODevice::WriteOnly ) return false;
+	
+	m_stream = new z_stream;
+	m_stream->zalloc = Z_NULL;
+	m_stream->zfree = Z_NULL;
+	m_stream->opaque = Z_NULL;
+	m_stream->next_in = Z_NULL;
+	m_stream->avail_in = 0;
+	
+	// 16 more bits of window asks zlib for a gzip header and trailer
+	int windowBits = m_format == Gzip ? MAX_WBITS + 16 : MAX_WBITS;
+	if( deflateInit2( m_stream, m_level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+	{
+		setErrorString( m_stream->msg ? QString::fromLatin1( m_stream->msg ) : tr( "Cannot initialize the compression" ) );
+		delete m_stream;
+		m_stream = 0;
+		return false;
+	}
+	
+	m_input.resize( inputSize );
+	m_sourceEnd = false;
+	m_finished = false;
+	
+	return QIODevice::open( mode | QIODevice::Unbuffered );
+}
+
+bool CompressedBodyDevice::isSequential() const
+{
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// the end is only reached once the stream is finished, a read error isn't one
+////////////////////////////////////////////////////////////
+bool CompressedBodyDevice::atEnd() const
+{
+	return m_finished;
+}
+
+void CompressedBodyDevice::close()
+{
+	if( m_stream )
+	{
+		deflateEnd( m_stream );
+		delete m_stream;
+		m_stream = 0;
+	}
+	
+	m_input.clear();
+	
+	QIODevice::close();
+}
+
+////////////////////////////////////////////////////////////
+/// compress the source until the buffer is full or the source has nothing more to give right now
+////////////////////////////////////////////////////////////
+qint64 CompressedBodyDevice::readData( char * data, qint64 maxSize )
+{
+	if( m_finished || !m_stream ) return -1;
+	
+	m_stream->next_out = reinterpret_cast< Bytef * >( data );
+	m_stream->avail_out = uInt( qMin( maxSize, qint64( 1 << 30 ) ) );
+	uInt outputSize = m_stream->avail_out;
+	
+	while( m_stream->avail_out > 0 )
+	{
+		if( m_stream->avail_in == 0 && !m_sourceEnd )
+		{
+			qint64 read = m_source->read( m_input.data(), m_input.size() );
+			if( read < 0 && !m_source->atEnd() )
+			{
+				// finishing the stream would send a valid compressed body of a truncated content
+				setErrorString( m_source->errorString() );
+				return -1;
+			}
+			
+			if( read < 0 || ( read == 0 && !m_source->isSequential() && m_source->atEnd() ) )
+			{
+				m_sourceEnd = true;
+			}
+			else if( read == 0 )
+			{
+				// wait for the source to have more data
+				break;
+			}
+			else
+			{
+				m_stream->next_in = reinterpret_cast< Bytef * >( m_input.data() );
+				m_stream->avail_in = uInt( read );
+			}
+		}
+		
+		int result = deflate( m_stream, m_sourceEnd ? Z_FINISH : Z_NO_FLUSH );
+		if( result == Z_STREAM_END )
+		{
+			m_finished = true;
+			break;
+		}
+		
+		if( result != Z_OK && result != Z_BUF_ERROR )
+		{
+			setErrorString( m_stream->msg ? QString::fromLatin1( m_stream->msg ) : tr( "Compression error" ) );
+			return -1;
+		}
+	}
+	
+	qint64 produced = outputSize - m_stream->avail_out;
+	
+	// a sequential device signals its end with -1
+	if( !produced && m_finished ) return -1;
+	
+	return produced;
+}
+
+qint64 CompressedBodyDevice::writeData( const char *, qint64 )
+{
+	return -1;
+}
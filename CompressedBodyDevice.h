@@ -0,0 +1,88 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_COMPRESSED_BODY_DEVICE
+#define SEND_FORM_COMPRESSED_BODY_DEVICE
+
+#include <QByteArray>
+#include <QIODevice>
+
+struct z_stream_s;
+
+////////////////////////////////////////////////////////////
+/// CompressedBodyDevice compresses another device while it is read.
+///
+/// Only a small input buffer is kept, the compressed data is produced
+/// in the buffer given by the reader.
+///
+/// A read error of the source is one of the device: read() returns -1 while atEnd() is false,
+/// and the stream is left unfinished.
+////////////////////////////////////////////////////////////
+class CompressedBodyDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	enum Format
+	{
+		Gzip,	///< gzip format ("Content-Encoding: gzip")
+		Deflate	///< zlib format ("Content-Encoding: deflate")
+	};
+	
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param source : the opened device to compress, it must stay valid while the device is used
+	/// \param level : the zlib compression level (1 to 9, or -1 for the default level)
+	/// \param format : the format of the compressed data
+	/// \param parent : the parent of the device
+	///
+	////////////////////////////////////////////////////////////
+	CompressedBodyDevice( QIODevice * source, int level, Format format, QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// Destructor
+	///
+	////////////////////////////////////////////////////////////
+	~CompressedBodyDevice();
+	
+	////////////////////////////////////////////////////////////
+	/// get the value of the "Content-Encoding" header matching the format
+	///
+	////////////////////////////////////////////////////////////
+	QByteArray contentEncoding() const;
+	
+	bool open( OpenMode mode );
+	bool isSequential() const;
+	bool atEnd() const;
+	void close();
+
+protected:
+	qint64 readData( char * data, qint64 maxSize );
+	qint64 writeData( const char * data, qint64 maxSize );
+
+private:
+	QIODevice * m_source;
+	int m_level;
+	Format m_format;
+	z_stream_s * m_stream;
+	QByteArray m_input;
+	bool m_sourceEnd;
+	bool m_finished;
+};
+
+#endif
@@ -0,0 +1,247 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "ContentSniffer.h"
+
+#include <QCache>
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <cstring>
+
+////////////////////////////////////////////////////////////
+/// a signature is made of bytes at the beginning of the content,
+/// and optionally of other bytes further
+////////////////////////////////////////////////////////////
+struct Signature
+{
+	const char * magic;
+	int size;
+	int offset2;
+	const char * magic2;
+	int size2;
+	const char * mime;
+};
+
+static const Signature signatures[] =
+{
+	{ "\x89PNG\r\n\x1A\n", 8, 0, 0, 0, "image/png" },
+	{ "\xFF\xD8\xFF", 3, 0, 0, 0, "image/jpeg" },
+	{ "GIF87a", 6, 0, 0, 0, "image/gif" },
+	{ "GIF89a", 6, 0, 0, 0, "image/gif" },
+	{ "II*\0", 4, 0, 0, 0, "image/tiff" },
+	{ "MM\0*", 4, 0, 0, 0, "image/tiff" },
+	{ "RIFF", 4, 8, "WEBP", 4, "image/webp" },
+	{ "RIFF", 4, 8, "WAVE", 4, "audio/wav" },
+	{ "RIFF", 4, 8, "AVI ", 4, "video/x-msvideo" },
+	{ "\0\0\1\0", 4, 0, 0, 0, "image/x-icon" },
+	{ "BM", 2, 0, 0, 0, "image/bmp" },
+	{ "%PDF-", 5, 0, 0, 0, "application/pdf" },
+	{ "%!PS", 4, 0, 0, 0, "application/postscript" },
+	{ "PK\3\4", 4, 0, 0, 0, "application/zip" },
+	{ "\x1F\x8B", 2, 0, 0, 0, "application/gzip" },
+	{ "BZh", 3, 0, 0, 0, "application/x-bzip2" },
+	{ "\xFD" "7zXZ\0", 6, 0, 0, 0, "application/x-xz" },
+	{ "7z\xBC\xAF\x27\x1C", 6, 0, 0, 0, "application/x-7z-compressed" },
+	{ "Rar!\x1A\x07", 6, 0, 0, 0, "application/vnd.rar" },
+	{ "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8, 0, 0, 0, "application/x-ole-storage" },
+	{ "SQLite format 3\0", 16, 0, 0, 0, "application/vnd.sqlite3" },
+	{ "\x7F" "ELF", 4, 0, 0, 0, "application/x-executable" },
+	{ "MZ", 2, 0, 0, 0, "application/vnd.microsoft.portable-executable" },
+	{ "\xCA\xFE\xBA\xBE", 4, 0, 0, 0, "application/java-vm" },
+	{ "\0asm", 4, 0, 0, 0, "application/wasm" },
+	{ "OggS", 4, 0, 0, 0, "application/ogg" },
+	{ "fLaC", 4, 0, 0, 0, "audio/flac" },
+	{ "ID3", 3, 0, 0, 0, "audio/mpeg" },
+	{ "\x1A\x45\xDF\xA3", 4, 0, 0, 0, "video/webm" },
+	{ "wOFF", 4, 0, 0, 0, "font/woff" },
+	{ "wOF2", 4, 0, 0, 0, "font/woff2" },
+	{ "\0\1\0\0\0", 5, 0, 0, 0, "font/ttf" },
+	{ "OTTO", 4, 0, 0, 0, "font/otf" },
+	
+	// signatures not at the beginning
+	{ "", 0, 4, "ftyp", 4, "video/mp4" },
+	{ "", 0, 257, "ustar", 5, "application/x-tar" }
+};
+
+static const int signatureCount = int( sizeof( signatures ) / sizeof( signatures[0] ) );
+
+////////////////////////////////////////////////////////////
+/// the signatures chained by their first byte, built once when the library is loaded
+////////////////////////////////////////////////////////////
+struct SignatureIndex
+{
+	short first[256];
+	short next[signatureCount];
+	short others;
+	
+	SignatureIndex()
+	{
+		for(int i = 0;i < 256;i++) first[i] = -1;
+		others = -1;
+		
+		// in reverse so each chain keeps the order of the table
+		for(int i = signatureCount - 1;i >= 0;i--)
+		{
+			short & head = signatures[i].size ? first[ uchar( signatures[i].magic[0] ) ] : others;
+			next[i] = head;
+			head = short( i );
+		}
+	}
+};
+
+static const SignatureIndex signatureIndex;
+
+////////////////////////////////////////////////////////////
+/// a short signature of printable characters ("BM", "MZ", "ID3"...) also begins some texts
+////////////////////////////////////////////////////////////
+static bool isWeak( const Signature & signature )
+{
+	if( signature.size >= 4 || signature.size2 ) return false;
+	
+	for(int i = 0;i < signature.size;i++)
+	{
+		uchar c = uchar( signature.magic[i] );
+		if( c < 0x20 || c > 0x7E ) return false;
+	}
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// text has no control character besides the white spaces (and escape for the terminals)
+////////////////////////////////////////////////////////////
+static bool hasControlCharacters( const QByteArray & head )
+{
+	int size = qMin( head.size(), int( ContentSniffer::SniffSize ) );
+	for(int i = 0;i < size;i++)
+	{
+		uchar c = uchar( head[i] );
+		if( c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != 0x1B ) return true;
+	}
+	
+	return false;
+}
+
+static bool matches( const Signature & signature, const QByteArray & head )
+{
+	if( head.size() < signature.size || std::memcmp( head.constData(), signature.magic, signature.size ) != 0 ) return false;
+	
+	if( !signature.size2 ) return true;
+	
+	return head.size() >= signature.offset2 + signature.size2 && std::memcmp( head.constData() + signature.offset2, signature.magic2, signature.size2 ) == 0;
+}
+
+////////////////////////////////////////////////////////////
+/// type of a file kept in the cache
+////////////////////////////////////////////////////////////
+struct SniffedFile
+{
+	qint64 size;
+	QDateTime modified;
+	QByteArray mime;
+	bool binary;
+};
+
+struct SnifferState
+{
+	SnifferState() : cache( 1024 ) {}
+	
+	QMutex mutex;
+	QCache< QString, SniffedFile > cache;
+};
+
+Q_GLOBAL_STATIC( SnifferState, snifferState )
+
+////////////////////////////////////////////////////////////
+/// get the content type of a file
+////////////////////////////////////////////////////////////
+QByteArray ContentSniffer::mimeType( const QFileInfo & fi, bool * binary )
+{
+	QString path = fi.absoluteFilePath();
+	QDateTime modified = fi.lastModified();
+	
+	{
+		QMutexLocker locker( &snifferState()->mutex );
+		SniffedFile * cached = snifferState()->cache.object( path );
+		if( cached && cached->size == fi.size() && cached->modified == modified )
+		{
+			if( binary ) *binary = cached->binary;
+			return cached->mime;
+		}
+	}
+	
+	if( binary ) *binary = false;
+	
+	QFile file( path );
+	if( !file.open( QIODevice::ReadOnly ) ) return QByteArray();
+	
+	SniffedFile * sniffed = new SniffedFile;
+	sniffed->size = fi.size();
+	sniffed->modified = modified;
+	sniffed->mime = sniff( file.read( SniffSize ), &sniffed->binary );
+	QByteArray mime = sniffed->mime;
+	if( binary ) *binary = sniffed->binary;
+	
+	QMutexLocker locker( &snifferState()->mutex );
+	snifferState()->cache.insert( path, sniffed );
+	
+	return mime;
+}
+
+////////////////////////////////////////////////////////////
+/// get the content type of the beginning of a content
+////////////////////////////////////////////////////////////
+QByteArray ContentSniffer::sniff( const QByteArray & head, bool * binary )
+{
+	bool dummy;
+	if( !binary ) binary = &dummy;
+	
+	*binary = false;
+	if( head.isEmpty() ) return "text/plain";
+	
+	const Signature * found = 0;
+	for(int i = signatureIndex.first[ uchar( head[0] ) ];i >= 0 && !found;i = signatureIndex.next[i])
+	{
+		if( matches( signatures[i], head ) ) found = &signatures[i];
+	}
+	
+	for(int i = signatureIndex.others;i >= 0 && !found;i = signatureIndex.next[i])
+	{
+		if( matches( signatures[i], head ) ) found = &signatures[i];
+	}
+	
+	// the content is only scanned when the signature doesn't tell it apart from a text
+	if( found )
+	{
+		*binary = !isWeak( *found ) || hasControlCharacters( head );
+		return found->mime;
+	}
+	
+	*binary = hasControlCharacters( head );
+	return *binary ? "application/octet-stream" : "text/plain";
+}
+
+////////////////////////////////////////////////////////////
+/// set the number of files whose type is kept
+////////////////////////////////////////////////////////////
+void ContentSniffer::setCacheSize( int entries )
+{
+	QMutexLocker locker( &snifferState()->mutex );
+	snifferState()->cache.setMaxCost( entries );
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_CONTENT_SNIFFER
+#define SEND_FORM_CONTENT_SNIFFER
+
+#include <QByteArray>
+#include <QFileInfo>
+
+////////////////////////////////////////////////////////////
+/// ContentSniffer finds the content type of a file from its first bytes.
+///
+/// The signatures of the common binary formats are looked up by their first byte,
+/// a content without a known signature is text unless it has control characters.
+/// The results are kept in a cache shared by the whole process, keyed on the path
+/// and checked against the size and the modification time of the file.
+////////////////////////////////////////////////////////////
+class ContentSniffer
+{
+public:
+	enum { SniffSize = 512 };
+	
+	////////////////////////////////////////////////////////////
+	/// get the content type of a file
+	///
+	/// \param fi : the file
+	/// \param binary : if not 0, set to true when the file can't be a text (see sniff())
+	///
+	/// \return the type of its signature, "text/plain" or "application/octet-stream", or a null array if the file can't be read
+	///
+	/// \remarks only the first SniffSize bytes are read, and only if the file isn't in the cache
+	///
+	////////////////////////////////////////////////////////////
+	static QByteArray mimeType( const QFileInfo & fi, bool * binary = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// get the content type of the beginning of a content
+	///
+	/// \param head : the first bytes of the content (at most SniffSize are used)
+	/// \param binary : if not 0, set to true when the content can't be a text: it has a signature of 4 bytes or more,
+	/// a container header or non-printable bytes, or it has control characters
+	///
+	/// \return the type of its signature, "text/plain" or "application/octet-stream"
+	///
+	/// \remarks a short signature of printable characters ("BM", "MZ", "ID3", "BZh") also begins some texts,
+	/// the content is then only binary if it has control characters
+	///
+	////////////////////////////////////////////////////////////
+	static QByteArray sniff( const QByteArray & head, bool * binary = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// set the number of files whose type is kept
+	///
+	/// \param entries : the number of files (1024 by default), the least recently used ones are forgotten first
+	///
+	////////////////////////////////////////////////////////////
+	static void setCacheSize( int entries );
+};
+
+#endif
@@ -0,0 +1,146 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "ContinueGateDevice.h"
+
+#include <QNetworkRequest>
+#include <QVariant>
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+ContinueGateDevice::ContinueGateDevice( QIODevice * source, int timeout, QObject * parent ) : QIODevice( parent )
+{
+	m_source = source;
+	m_source->setParent( this );
+	m_released = false;
+	m_rejected = false;
+	
+	m_timer.setSingleShot( true );
+	m_timer.setInterval( timeout );
+	connect( &m_timer, SIGNAL( timeout() ), this, SLOT( release() ) );
+	connect( source, SIGNAL( readyRead() ), this, SIGNAL( readyRead() ) );
+}
+
+////////////////////////////////////////////////////////////
+/// follow the reply of the request
+////////////////////////////////////////////////////////////
+void ContinueGateDevice::watch( QNetworkReply * reply )
+{
+	connect( reply, SIGNAL( metaDataChanged() ), this, SLOT( replyMetaDataChanged() ) );
+	connect( reply, SIGNAL( finished() ), this, SLOT( replyFinished() ) );
+}
+
+bool ContinueGateDevice::open( OpenMode mode )
+{
+	if( mode & QIODevice::WriteOnly ) return false;
+	
+	return QIODevice::open( mode | QIODevice::Unbuffered );
+}
+
+bool ContinueGateDevice::isSequential() const
+{
+	return true;
+}
+
+qint64 ContinueGateDevice::size() const
+{
+	return m_source->size();
+}
+
+qint64 ContinueGateDevice::bytesAvailable() const
+{
+	return m_released ? m_source->bytesAvailable() : 0;
+}
+
+////////////////////////////////////////////////////////////
+/// the body isn't over while it is held back
+////////////////////////////////////////////////////////////
+bool ContinueGateDevice::atEnd() const
+{
+	return m_released && m_source->atEnd();
+}
+
+////////////////////////////////////////////////////////////
+/// give nothing until the gate is released, the first read means the headers are being sent
+////////////////////////////////////////////////////////////
+qint64 ContinueGateDevice::readData( char * data, qint64 maxSize )
+{
+	if( m_rejected ) return -1;
+	
+	if( !m_released )
+	{
+		if( !m_timer.isActive() ) m_timer.start();
+		return 0;
+	}
+	
+	qint64 read = m_source->read( data, maxSize );
+	
+	// the source may be random-access, the end of a sequential device is -1
+	if( read == 0 && m_source->atEnd() ) return -1;
+	
+	return read;
+}
+
+qint64 ContinueGateDevice::writeData( const char *, qint64 )
+{
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+/// no answer before the timeout, send the body anyway
+////////////////////////////////////////////////////////////
+void ContinueGateDevice::release()
+{
+	if( m_released || m_rejected ) return;
+	
+	m_timer.stop();
+	m_released = true;
+	emit readyRead();
+}
+
+////////////////////////////////////////////////////////////
+/// a final status received before the body was given rejects it
+////////////////////////////////////////////////////////////
+void ContinueGateDevice::replyMetaDataChanged()
+{
+	if( m_released ) return;
+	
+	QNetworkReply * reply = qobject_cast< QNetworkReply * >( sender() );
+	int status = reply->attribute( QNetworkRequest::HttpStatusCodeAttribute ).toInt();
+	
+	if( status == 100 )
+	{
+		release();
+	}
+	else if( status >= 200 )
+	{
+		m_timer.stop();
+		m_rejected = true;
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// the reply ended before the body was given, it will never be
+////////////////////////////////////////////////////////////
+void ContinueGateDevice::replyFinished()
+{
+	if( m_released ) return;
+	
+	m_timer.stop();
+	m_rejected = true;
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_CONTINUE_GATE_DEVICE
+#define SEND_FORM_CONTINUE_GATE_DEVICE
+
+#include <QIODevice>
+#include <QNetworkReply>
+#include <QTimer>
+
+////////////////////////////////////////////////////////////
+/// ContinueGateDevice holds a body back after the headers of an "Expect: 100-continue" request.
+///
+/// QNetworkAccessManager doesn't report the "100 Continue" interim response, so the body
+/// is given like curl does: after a timeout, unless the reply has ended or received its
+/// final status before. A server rejecting the request right away then never gets the body.
+////////////////////////////////////////////////////////////
+class ContinueGateDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param source : the opened body, it becomes a child of the gate
+	/// \param timeout : the time to wait before giving the body, in milliseconds
+	/// \param parent : the parent of the device
+	///
+	////////////////////////////////////////////////////////////
+	ContinueGateDevice( QIODevice * source, int timeout, QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// follow the reply of the request, the body is never given if it is rejected before the timeout
+	///
+	/// \param reply : the reply of the request sending this body
+	///
+	////////////////////////////////////////////////////////////
+	void watch( QNetworkReply * reply );
+	
+	bool open( OpenMode mode );
+	bool isSequential() const;
+	qint64 size() const;
+	qint64 bytesAvailable() const;
+	bool atEnd() const;
+
+protected:
+	qint64 readData( char * data, qint64 maxSize );
+	qint64 writeData( const char * data, qint64 maxSize );
+
+private slots:
+	void release();
+	void replyMetaDataChanged();
+	void replyFinished();
+
+private:
+	QIODevice * m_source;
+	QTimer m_timer;
+	bool m_released;
+	bool m_rejected;
+};
+
+#endif
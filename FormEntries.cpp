@@ -0,0 +1,309 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "FormEntries.h"
+
+#include <cstring>
+
+////////////////////////////////////////////////////////////
+/// number of bytes store() writes for UTF-16 text
+////////////////////////////////////////////////////////////
+static int utf8Length( const ushort * in, int length )
+{
+	int bytes = 0;
+	
+	for(int i = 0;i < length;i++)
+	{
+		uint c = in[i];
+		
+		if( c < 0x80 )
+		{
+			bytes += 1;
+		}
+		else if( c < 0x800 )
+		{
+			bytes += 2;
+		}
+		else if( c >= 0xD800 && c < 0xDC00 && i + 1 < length && in[i + 1] >= 0xDC00 && in[i + 1] < 0xE000 )
+		{
+			bytes += 4;
+			i++;
+		}
+		else
+		{
+			// other units and lone surrogates (written as U+FFFD)
+			bytes += 3;
+		}
+	}
+	
+	return bytes;
+}
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+FormEntries::FormEntries()
+{
+	m_used = 0;
+	m_garbage = 0;
+}
+
+////////////////////////////////////////////////////////////
+/// reserve room for entries
+////////////////////////////////////////////////////////////
+void FormEntries::reserve( int entries, int bytes )
+{
+	m_entries.reserve( entries );
+	
+	if( m_used + bytes > m_arena.size() )
+	{
+		m_arena.resize( m_used + bytes );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// add an entry after the others
+////////////////////////////////////////////////////////////
+void FormEntries::append( const QString & name, const QString & value )
+{
+	Entry entry;
+	entry.nameOffset = store( name );
+	entry.nameSize = m_used - entry.nameOffset;
+	entry.valueOffset = store( value );
+	entry.valueSize = m_used - entry.valueOffset;
+	
+	m_entries.append( entry );
+}
+
+////////////////////////////////////////////////////////////
+/// add an entry already encoded in UTF-8 after the others
+////////////////////////////////////////////////////////////
+void FormEntries::append( const QByteArray & name, const QByteArray & value )
+{
+	Entry entry;
+	entry.nameOffset = store( name.constData(), name.size() );
+	entry.nameSize = name.size();
+	entry.valueOffset = store( value.constData(), value.size() );
+	entry.valueSize = value.size();
+	
+	m_entries.append( entry );
+}
+
+////////////////////////////////////////////////////////////
+/// replace all the values of a name by a single one
+////////////////////////////////////////////////////////////
+void FormEntries::set( const QString & name, const QString & value )
+{
+	QByteArray utf8 = name.toUtf8();
+	
+	int first = find( utf8.constData(), utf8.size(), 0 );
+	if( first < 0 )
+	{
+		append( name, value );
+		return;
+	}
+	
+	for(int i = find( utf8.constData(), utf8.size(), first + 1 );i >= 0;i = find( utf8.constData(), utf8.size(), i ))
+	{
+		m_garbage += m_entries[i].nameSize + m_entries[i].valueSize;
+		m_entries.remove( i );
+	}
+	
+	int offset = store( value );
+	
+	Entry & entry = m_entries[first];
+	m_garbage += entry.valueSize;
+	entry.valueOffset = offset;
+	entry.valueSize = m_used - offset;
+	entry.encoded = QByteArray();
+	
+	// don't let the replaced values take more room than the live ones
+	if( m_garbage > m_used / 2 ) compact();
+}
+
+////////////////////////////////////////////////////////////
+/// remove all the entries
+////////////////////////////////////////////////////////////
+void FormEntries::clear()
+{
+	// the buffer is kept for the next entries
+	m_entries.clear();
+	m_used = 0;
+	m_garbage = 0;
+}
+
+int FormEntries::count() const
+{
+	return m_entries.count();
+}
+
+bool FormEntries::isEmpty() const
+{
+	return m_entries.isEmpty();
+}
+
+////////////////////////////////////////////////////////////
+/// get the name of an entry in UTF-8
+////////////////////////////////////////////////////////////
+QByteArray FormEntries::name( int i ) const
+{
+	const Entry & entry = m_entries.at( i );
+	return QByteArray::fromRawData( m_arena.constData() + entry.nameOffset, entry.nameSize );
+}
+
+////////////////////////////////////////////////////////////
+/// get the value of an entry in UTF-8
+////////////////////////////////////////////////////////////
+QByteArray FormEntries::value( int i ) const
+{
+	const Entry & entry = m_entries.at( i );
+	return QByteArray::fromRawData( m_arena.constData() + entry.valueOffset, entry.valueSize );
+}
+
+const QByteArray & FormEntries::encoded( int i ) const
+{
+	return m_entries.at( i ).encoded;
+}
+
+void FormEntries::setEncoded( int i, const QByteArray & data )
+{
+	m_entries[i].encoded = data;
+}
+
+////////////////////////////////////////////////////////////
+/// write a string in UTF-8 at the end of the buffer and return its offset
+////////////////////////////////////////////////////////////
+int FormEntries::store( const QString & text )
+{
+	int offset = m_used;
+	int length = text.length();
+	const ushort * in = text.utf16();
+	
+	// a UTF-16 unit never takes more than 3 bytes in UTF-8, the exact length is only needed
+	// when the worst case doesn't fit, so the room given to reserve() is used up before growing
+	if( m_used + length * 3 > m_arena.size() )
+	{
+		int bytes = utf8Length( in, length );
+		if( m_used + bytes > m_arena.size() )
+		{
+			m_arena.resize( qMax( m_arena.size() * 2, m_used + bytes ) );
+		}
+	}
+	
+	uchar * out = reinterpret_cast< uchar * >( m_arena.data() ) + m_used;
+	uchar * start = out;
+	
+	for(int i = 0;i < length;i++)
+	{
+		uint c = in[i];
+		
+		if( c < 0x80 )
+		{
+			*out++ = uchar( c );
+			continue;
+		}
+		
+		if( c >= 0xD800 && c < 0xDC00 && i + 1 < length && in[i + 1] >= 0xDC00 && in[i + 1] < 0xE000 )
+		{
+			// surrogate pair, 4 bytes for 2 units
+			c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( in[++i] - 0xDC00 );
+			*out++ = uchar( 0xF0 | ( c >> 18 ) );
+			*out++ = uchar( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+			*out++ = uchar( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+			*out++ = uchar( 0x80 | ( c & 0x3F ) );
+			continue;
+		}
+		
+		// a lone surrogate is replaced by U+FFFD
+		if( c >= 0xD800 && c < 0xE000 ) c = 0xFFFD;
+		
+		if( c < 0x800 )
+		{
+			*out++ = uchar( 0xC0 | ( c >> 6 ) );
+		}
+		else
+		{
+			*out++ = uchar( 0xE0 | ( c >> 12 ) );
+			*out++ = uchar( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+		}
+		*out++ = uchar( 0x80 | ( c & 0x3F ) );
+	}
+	
+	m_used += int( out - start );
+	return offset;
+}
+
+////////////////////////////////////////////////////////////
+/// copy bytes at the end of the buffer and return their offset
+////////////////////////////////////////////////////////////
+int FormEntries::store( const char * data, int size )
+{
+	int offset = m_used;
+	
+	if( m_used + size > m_arena.size() )
+	{
+		m_arena.resize( qMax( m_arena.size() * 2, m_used + size ) );
+	}
+	
+	std::memcpy( m_arena.data() + m_used, data, size );
+	m_used += size;
+	return offset;
+}
+
+////////////////////////////////////////////////////////////
+/// find the next entry with a name, starting at from
+////////////////////////////////////////////////////////////
+int FormEntries::find( const char * name, int size, int from ) const
+{
+	for(int i = from;i < m_entries.count();i++)
+	{
+		const Entry & entry = m_entries.at( i );
+		if( entry.nameSize == size && std::memcmp( m_arena.constData() + entry.nameOffset, name, size ) == 0 )
+		{
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+/// move the live names and values to a new buffer, dropping the replaced ones
+////////////////////////////////////////////////////////////
+void FormEntries::compact()
+{
+	QByteArray arena;
+	arena.resize( m_arena.size() );
+	
+	int used = 0;
+	for(int i = 0;i < m_entries.count();i++)
+	{
+		Entry & entry = m_entries[i];
+		
+		std::memcpy( arena.data() + used, m_arena.constData() + entry.nameOffset, entry.nameSize );
+		entry.nameOffset = used;
+		used += entry.nameSize;
+		
+		std::memcpy( arena.data() + used, m_arena.constData() + entry.valueOffset, entry.valueSize );
+		entry.valueOffset = used;
+		used += entry.valueSize;
+	}
+	
+	m_arena = arena;
+	m_used = used;
+	m_garbage = 0;
+}
@@ -0,0 +1,148 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_ENTRIES
+#define SEND_FORM_ENTRIES
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+////////////////////////////////////////////////////////////
+/// FormEntries stores the (name, value) pairs of a form in the order they were added.
+///
+/// A name can have several values. Names and values are stored in UTF-8
+/// one after the other in a single buffer, and the entries only keep their offsets,
+/// so adding an entry doesn't allocate anything once enough room has been reserved.
+////////////////////////////////////////////////////////////
+class FormEntries
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	////////////////////////////////////////////////////////////
+	FormEntries();
+	
+	////////////////////////////////////////////////////////////
+	/// reserve room for entries
+	///
+	/// \param entries : the number of entries
+	/// \param bytes : the total size of the names and the values in UTF-8
+	///
+	////////////////////////////////////////////////////////////
+	void reserve( int entries, int bytes );
+	
+	////////////////////////////////////////////////////////////
+	/// add an entry after the others
+	///
+	/// \param name : the name of the entry
+	/// \param value : the value of the entry
+	///
+	////////////////////////////////////////////////////////////
+	void append( const QString & name, const QString & value );
+	
+	////////////////////////////////////////////////////////////
+	/// add an entry already encoded in UTF-8 after the others
+	///
+	/// \param name : the name of the entry
+	/// \param value : the value of the entry
+	///
+	////////////////////////////////////////////////////////////
+	void append( const QByteArray & name, const QByteArray & value );
+	
+	////////////////////////////////////////////////////////////
+	/// replace all the values of a name by a single one
+	///
+	/// \param name : the name of the entry
+	/// \param value : the new value
+	///
+	/// \remarks the entry keeps the position of the first value, it is appended if the name doesn't exist
+	///
+	////////////////////////////////////////////////////////////
+	void set( const QString & name, const QString & value );
+	
+	////////////////////////////////////////////////////////////
+	/// remove all the entries
+	///
+	////////////////////////////////////////////////////////////
+	void clear();
+	
+	int count() const;
+	bool isEmpty() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the name of an entry in UTF-8
+	///
+	/// \param i : the index of the entry
+	///
+	/// \remarks the data isn't copied, it is only valid until the entries are modified
+	///
+	////////////////////////////////////////////////////////////
+	QByteArray name( int i ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the value of an entry in UTF-8
+	///
+	/// \param i : the index of the entry
+	///
+	/// \remarks the data isn't copied, it is only valid until the entries are modified
+	///
+	////////////////////////////////////////////////////////////
+	QByteArray value( int i ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the encoded form of an entry saved with setEncoded()
+	///
+	/// \param i : the index of the entry
+	///
+	/// \return the encoded entry, or a null QByteArray if the entry has changed since then
+	///
+	////////////////////////////////////////////////////////////
+	const QByteArray & encoded( int i ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// save the encoded form of an entry, it is forgotten when the entry changes
+	///
+	/// \param i : the index of the entry
+	/// \param data : the encoded entry
+	///
+	////////////////////////////////////////////////////////////
+	void setEncoded( int i, const QByteArray & data );
+
+private:
+	struct Entry
+	{
+		int nameOffset;
+		int nameSize;
+		int valueOffset;
+		int valueSize;
+		QByteArray encoded;
+	};
+	
+	QVector< Entry > m_entries;
+	QByteArray m_arena;
+	int m_used;
+	int m_garbage;
+	
+	int store( const QString & text );
+	int store( const char * data, int size );
+	int find( const char * name, int size, int from ) const;
+	void compact();
+};
+
+#endif
@@ -0,0 +1,156 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "FormUrlEncoder.h"
+
+#include <cstring>
+
+// SEND_FORM_NO_SIMD forces the scalar loops, the tests use it to compare both paths
+#if !defined( SEND_FORM_NO_SIMD ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#define SEND_FORM_SSE2
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////
+/// what to do with each ASCII character: 0 = "%XX", 1 = copy, 2 = '+'
+////////////////////////////////////////////////////////////
+static const char actions[128] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
+};
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+#ifdef SEND_FORM_SSE2
+////////////////////////////////////////////////////////////
+/// one bit per byte that can be copied as it is
+////////////////////////////////////////////////////////////
+static inline int safeMask( const char * data )
+{
+	__m128i bytes = _mm_loadu_si128( reinterpret_cast< const __m128i * >( data ) );
+	
+	// bytes above 127 are negative, so they are outside all the ranges
+	__m128i digits = _mm_and_si128( _mm_cmpgt_epi8( bytes, _mm_set1_epi8( '0' - 1 ) ), _mm_cmplt_epi8( bytes, _mm_set1_epi8( '9' + 1 ) ) );
+	
+	// clearing 0x20 turns lower case letters into upper case ones
+	__m128i upper = _mm_and_si128( bytes, _mm_set1_epi8( char( 0xDF ) ) );
+	__m128i letters = _mm_and_si128( _mm_cmpgt_epi8( upper, _mm_set1_epi8( 'A' - 1 ) ), _mm_cmplt_epi8( upper, _mm_set1_epi8( 'Z' + 1 ) ) );
+	
+	__m128i marks = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( '-' ) ), _mm_cmpeq_epi8( bytes, _mm_set1_epi8( '.' ) ) ),
+		_mm_or_si128( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( '_' ) ), _mm_cmpeq_epi8( bytes, _mm_set1_epi8( '*' ) ) ) );
+	
+	return _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( digits, letters ), marks ) );
+}
+#endif
+
+static inline int byteLength( uchar c )
+{
+	return c < 128 && actions[c] ? 1 : 3;
+}
+
+static inline char * encodeByte( uchar c, char * out )
+{
+	int action = c < 128 ? actions[c] : 0;
+	
+	if( action == 1 )
+	{
+		*out++ = char( c );
+	}
+	else if( action == 2 )
+	{
+		*out++ = '+';
+	}
+	else
+	{
+		*out++ = '%';
+		*out++ = hexDigits[c >> 4];
+		*out++ = hexDigits[c & 15];
+	}
+	
+	return out;
+}
+
+////////////////////////////////////////////////////////////
+/// compute the length of encoded data
+////////////////////////////////////////////////////////////
+int FormUrlEncoder::encodedLength( const char * data, int size )
+{
+	int length = 0;
+	int i = 0;
+	
+#ifdef SEND_FORM_SSE2
+	for(;i + 16 <= size;i += 16)
+	{
+		if( safeMask( data + i ) == 0xFFFF )
+		{
+			length += 16;
+			continue;
+		}
+		
+		for(int j = i;j < i + 16;j++)
+		{
+			length += byteLength( uchar( data[j] ) );
+		}
+	}
+#endif
+	
+	for(;i < size;i++)
+	{
+		length += byteLength( uchar( data[i] ) );
+	}
+	
+	return length;
+}
+
+////////////////////////////////////////////////////////////
+/// encode data
+////////////////////////////////////////////////////////////
+char * FormUrlEncoder::encode( const char * data, int size, char * out )
+{
+	int i = 0;
+	
+#ifdef SEND_FORM_SSE2
+	for(;i + 16 <= size;i += 16)
+	{
+		if( safeMask( data + i ) == 0xFFFF )
+		{
+			std::memcpy( out, data + i, 16 );
+			out += 16;
+			continue;
+		}
+		
+		for(int j = i;j < i + 16;j++)
+		{
+			out = encodeByte( uchar( data[j] ), out );
+		}
+	}
+#endif
+	
+	for(;i < size;i++)
+	{
+		out = encodeByte( uchar( data[i] ), out );
+	}
+	
+	return out;
+}
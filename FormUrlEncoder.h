@@ -0,0 +1,56 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_URL_ENCODER
+#define SEND_FORM_URL_ENCODER
+
+#include <QByteArray>
+
+////////////////////////////////////////////////////////////
+/// FormUrlEncoder percent-encodes text for an "application/x-www-form-urlencoded" body.
+///
+/// Letters, digits and "-._*" are copied, spaces become '+' and every other byte becomes "%XX".
+/// Runs of bytes that are copied are checked 16 at a time with SSE2 when it's available.
+////////////////////////////////////////////////////////////
+class FormUrlEncoder
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// compute the length of encoded data
+	///
+	/// \param data : the UTF-8 data to encode
+	/// \param size : the size of the data
+	///
+	/// \return the number of bytes encode() will write
+	///
+	////////////////////////////////////////////////////////////
+	static int encodedLength( const char * data, int size );
+	
+	////////////////////////////////////////////////////////////
+	/// encode data
+	///
+	/// \param data : the UTF-8 data to encode
+	/// \param size : the size of the data
+	/// \param out : where to write the encoded data, there must be room for encodedLength( data, size ) bytes
+	///
+	/// \return the position after the last byte written
+	///
+	////////////////////////////////////////////////////////////
+	static char * encode( const char * data, int size, char * out );
+};
+
+#endif
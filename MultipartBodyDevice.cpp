@@ -0,0 +1,436 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "MultipartBodyDevice.h"
+
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <cstring>
+
+#if defined( Q_OS_LINUX )
+#include <sys/vfs.h>
+#endif
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+MultipartBodyDevice::MultipartBodyDevice( QObject * parent ) : QIODevice( parent )
+{
+	m_size = 0;
+	m_sizeKnown = true;
+	m_sequential = false;
+	m_part = 0;
+	m_partOffset = 0;
+	m_map = 0;
+	m_fileReadTime = 0;
+	m_lastDigestSource = -1;
+}
+
+////////////////////////////////////////////////////////////
+/// a mapped file truncated by someone else faults the copy (SIGBUS) instead of failing a read,
+/// so the files others can write and the ones of network file systems aren't mapped
+////////////////////////////////////////////////////////////
+static bool canMap( const QFile & file )
+{
+#if defined( Q_OS_WIN )
+	// a mapped file can't be truncated
+	Q_UNUSED( file );
+	return true;
+#else
+	if( file.permissions() & ( QFile::WriteGroup | QFile::WriteOther ) ) return false;
+	
+#if defined( Q_OS_LINUX )
+	struct statfs fs;
+	if( fstatfs( file.handle(), &fs ) != 0 ) return false;
+	
+	switch( quint32( fs.f_type ) )
+	{
+		case 0x6969:		// NFS
+		case 0x517B:		// SMB
+		case 0xFF534D42:	// CIFS
+		case 0xFE534D42:	// SMB2
+		case 0x65735546:	// FUSE (sshfs, ...)
+			return false;
+	}
+#endif
+	
+	return true;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// append some data to the body
+////////////////////////////////////////////////////////////
+void MultipartBodyDevice::appendData( const QByteArray & data )
+{
+	if( data.isEmpty() ) return;
+	
+	Part part;
+	part.data = data;
+	part.size = data.size();
+	
+	m_parts.append( part );
+	m_size += part.size;
+}
+
+////////////////////////////////////////////////////////////
+/// append the content of a file to the body
+////////////////////////////////////////////////////////////
+bool MultipartBodyDevice::appendFile( const QString & path, PartDigest * digest )
+{
+	QSharedPointer< PartDigest > shared( digest );
+	
+	QFileInfo fi( path );
+	if( !fi.isFile() || !fi.isReadable() ) return false;
+	
+	Part part;
+	part.path = fi.absoluteFilePath();
+	part.size = fi.size();
+	part.digest = shared;
+	
+	// the digest of an empty file is the one of no data
+	m_lastDigest = shared;
+	m_lastDigestSource = -1;
+	
+	if( part.size > 0 )
+	{
+		m_lastDigestSource = m_parts.count();
+		m_parts.append( part );
+		m_size += part.size;
+	}
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// append a digest of the last file appended
+////////////////////////////////////////////////////////////
+void MultipartBodyDevice::appendDigest( PartDigest::Algorithm algorithm, const QByteArray & prefix, const QByteArray & suffix )
+{
+	if( !m_lastDigest ) return;
+	
+	// the size is known, the digest replaces the zeros once the file has been read
+	Part part;
+	part.data = prefix + QByteArray( PartDigest::resultSize( algorithm ) * 2, '0' ) + suffix;
+	part.size = part.data.size();
+	part.digest = m_lastDigest;
+	part.digestSource = m_lastDigestSource;
+	part.digestAlgorithm = algorithm;
+	part.digestOffset = prefix.size();
+	
+	m_parts.append( part );
+	m_size += part.size;
+}
+
+////////////////////////////////////////////////////////////
+/// append the content of another device to the body
+////////////////////////////////////////////////////////////
+void MultipartBodyDevice::appendDevice( QIODevice * device, qint64 size )
+{
+	Part part;
+	part.device = device;
+	part.size = size;
+	
+	// where to come back when the body is rewound
+	if( !device->isSequential() ) part.start = device->pos();
+	
+	if( size < 0 ) m_sizeKnown = false;
+	else m_size += size;
+	
+	if( size < 0 || device->isSequential() ) m_sequential = true;
+	
+	m_parts.append( part );
+	
+	connect( device, SIGNAL( readyRead() ), this, SIGNAL( readyRead() ) );
+	connect( device, SIGNAL( readChannelFinished() ), this, SLOT( deviceFinished() ) );
+}
+
+qint64 MultipartBodyDevice::fileReadTime() const
+{
+	return m_fileReadTime;
+}
+
+bool MultipartBodyDevice::isSequential() const
+{
+	return m_sequential;
+}
+
+qint64 MultipartBodyDevice::size() const
+{
+	return m_sizeKnown ? m_size : QIODevice::size();
+}
+
+////////////////////////////////////////////////////////////
+/// a sequential body ends after its last part, a read error before doesn't end it
+////////////////////////////////////////////////////////////
+bool MultipartBodyDevice::atEnd() const
+{
+	if( !m_sequential ) return QIODevice::atEnd();
+	
+	return m_part >= m_parts.count();
+}
+
+////////////////////////////////////////////////////////////
+/// move to the part containing pos
+////////////////////////////////////////////////////////////
+bool MultipartBodyDevice::seek( qint64 pos )
+{
+	if( m_sequential || pos < 0 || pos > m_size || !QIODevice::seek( pos ) ) return false;
+	
+	closeFile();
+	m_part = 0;
+	m_partOffset = pos;
+	
+	while( m_part < m_parts.count() && m_partOffset >= m_parts[m_part].size )
+	{
+		m_partOffset -= m_parts[m_part].size;
+		m_part++;
+	}
+	
+	rewindDevice();
+	
+	return true;
+}
+
+void MultipartBodyDevice::close()
+{
+	closeFile();
+	QIODevice::close();
+}
+
+////////////////////////////////////////////////////////////
+/// copy the next bytes of the body, opening the files when they are reached
+////////////////////////////////////////////////////////////
+qint64 MultipartBodyDevice::readData( char * data, qint64 maxSize )
+{
+	qint64 total = 0;
+	
+	while( total < maxSize && m_part < m_parts.count() )
+	{
+		Part & part = m_parts[m_part];
+		
+		if( part.digestAlgorithm && !part.digestWritten && !writeDigest( part ) )
+		{
+			return total ? total : -1;
+		}
+		
+		qint64 chunk = maxSize - total;
+		if( part.size >= 0 ) chunk = qMin( part.size - m_partOffset, chunk );
+		
+		if( part.device )
+		{
+			chunk = part.device->read( data + total, chunk );
+			
+			// -1 is the end of a sequential device, but an error before the end of a random-access one
+			if( chunk < 0 && !part.device->isSequential() && !part.device->atEnd() )
+			{
+				setErrorString( part.device->errorString() );
+				return total ? total : -1;
+			}
+			
+			if( chunk < 0 || ( chunk == 0 && deviceAtEnd( part.device ) ) )
+			{
+				if( part.size >= 0 )
+				{
+					setErrorString( tr( "Unexpected end of device" ) );
+					return total ? total : -1;
+				}
+				
+				nextPart();
+				continue;
+			}
+			
+			// nothing available right now, readyRead() will be emitted when there is more
+			if( chunk == 0 ) break;
+		}
+		else if( part.path.isEmpty() )
+		{
+			std::memcpy( data + total, part.data.constData() + m_partOffset, chunk );
+		}
+		else
+		{
+			QElapsedTimer timer;
+			timer.start();
+			
+			if( !m_file.isOpen() && !openFile( part ) )
+			{
+				setErrorString( m_file.errorString() );
+				return total ? total : -1;
+			}
+			
+			if( m_map )
+			{
+				// copying from the mapping of a truncated file would fault, the size checked before each slice
+				// catches a truncation done between two slices, not one done during the copy
+				if( m_file.size() < part.size )
+				{
+					m_fileReadTime += timer.nsecsElapsed();
+					setErrorString( tr( "Unexpected end of file: %1" ).arg( part.path ) );
+					return total ? total : -1;
+				}
+				
+				std::memcpy( data + total, m_map + m_partOffset, chunk );
+			}
+			else
+			{
+				chunk = m_file.read( data + total, chunk );
+			}
+			
+			if( chunk > 0 && part.digest && m_partOffset == part.hashed )
+			{
+				// the file is hashed as long as it is read in order
+				part.digest->addData( data + total, chunk );
+				part.hashed += chunk;
+			}
+			
+			m_fileReadTime += timer.nsecsElapsed();
+			
+			if( chunk <= 0 )
+			{
+				// the file has been truncated since it was appended
+				setErrorString( tr( "Unexpected end of file: %1" ).arg( part.path ) );
+				return total ? total : -1;
+			}
+		}
+		
+		total += chunk;
+		m_partOffset += chunk;
+		
+		if( m_partOffset == part.size ) nextPart();
+	}
+	
+	// a sequential device signals its end with -1
+	if( !total && m_sequential && m_part == m_parts.count() ) return -1;
+	
+	return total;
+}
+
+qint64 MultipartBodyDevice::writeData( const char *, qint64 )
+{
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+/// open the file of a part, mapping it in memory when possible
+////////////////////////////////////////////////////////////
+bool MultipartBodyDevice::openFile( const Part & part )
+{
+	m_file.setFileName( part.path );
+	if( !m_file.open( QIODevice::ReadOnly | QIODevice::Unbuffered ) ) return false;
+	
+	// the content is then copied directly from the page cache to the network buffer,
+	// files that can't be mapped (too big for the address space, special files, ...) are read
+	m_map = canMap( m_file ) ? m_file.map( 0, part.size ) : 0;
+	if( !m_map && !m_file.seek( m_partOffset ) )
+	{
+		m_file.close();
+		return false;
+	}
+	
+	return true;
+}
+
+void MultipartBodyDevice::closeFile()
+{
+	if( m_map )
+	{
+		m_file.unmap( m_map );
+		m_map = 0;
+	}
+	
+	m_file.close();
+}
+
+void MultipartBodyDevice::nextPart()
+{
+	closeFile();
+	m_part++;
+	m_partOffset = 0;
+	
+	rewindDevice();
+}
+
+////////////////////////////////////////////////////////////
+/// move the device of the current part to the offset being read
+////////////////////////////////////////////////////////////
+void MultipartBodyDevice::rewindDevice()
+{
+	if( m_part >= m_parts.count() ) return;
+	
+	const Part & part = m_parts[m_part];
+	if( part.device && !part.device->isSequential() )
+	{
+		part.device->seek( part.start + m_partOffset );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// replace the zeros of a digest part by the digest of its file
+////////////////////////////////////////////////////////////
+bool MultipartBodyDevice::writeDigest( Part & part )
+{
+	if( part.digestSource >= 0 )
+	{
+		Part & source = m_parts[part.digestSource];
+		
+		// the file hasn't been read entirely in order (the body was read from the middle)
+		if( source.hashed != source.size )
+		{
+			QElapsedTimer timer;
+			timer.start();
+			
+			source.digest->reset();
+			bool read = source.digest->addFile( source.path );
+			source.hashed = read ? source.size : 0;
+			
+			m_fileReadTime += timer.nsecsElapsed();
+			
+			if( !read )
+			{
+				setErrorString( tr( "Cannot read the file: %1" ).arg( source.path ) );
+				return false;
+			}
+		}
+	}
+	
+	QByteArray hex = part.digest->result( PartDigest::Algorithm( part.digestAlgorithm ) ).toHex();
+	std::memcpy( part.data.data() + part.digestOffset, hex.constData(), hex.size() );
+	part.digestWritten = true;
+	
+	return true;
+}
+
+bool MultipartBodyDevice::deviceAtEnd( QIODevice * device ) const
+{
+	if( !device->isOpen() ) return true;
+	
+	return device->isSequential() ? m_finishedDevices.contains( device ) : device->atEnd();
+}
+
+////////////////////////////////////////////////////////////
+/// a sequential device won't receive more data
+////////////////////////////////////////////////////////////
+void MultipartBodyDevice::deviceFinished()
+{
+	QIODevice * device = qobject_cast< QIODevice * >( sender() );
+	if( !device ) return;
+	
+	m_finishedDevices.insert( device );
+	
+	// let the reader find out that the part has ended
+	emit readyRead();
+}
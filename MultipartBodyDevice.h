@@ -0,0 +1,166 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_MULTIPART_BODY_DEVICE
+#define SEND_FORM_MULTIPART_BODY_DEVICE
+
+#include "PartDigest.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+#include <QList>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+
+////////////////////////////////////////////////////////////
+/// MultipartBodyDevice generates the body of a form on demand.
+///
+/// The body is described as a list of parts (in-memory data, files or other devices)
+/// and the content of the files is only read when the network layer asks for it,
+/// so the memory used doesn't depend on the size of the files.
+///
+/// Files are mapped in memory while they are sent, so their content is copied only once,
+/// from the mapping to the buffer of the network layer. The files others can write, and
+/// on Linux the ones of network file systems, are read instead.
+///
+/// The digests of the files can be computed while they are sent, and written after them.
+////////////////////////////////////////////////////////////
+class MultipartBodyDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param parent : the parent of the device
+	///
+	////////////////////////////////////////////////////////////
+	MultipartBodyDevice( QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// append some data to the body (boundaries, headers of a part, value of a field, ...)
+	///
+	/// \param data : the data to append
+	///
+	////////////////////////////////////////////////////////////
+	void appendData( const QByteArray & data );
+	
+	////////////////////////////////////////////////////////////
+	/// append the content of a file to the body
+	///
+	/// \param path : the file path
+	/// \param digest : the digest computed while the file is read (or 0), the device takes its ownership
+	///
+	/// \return false if the file can't be read
+	///
+	/// \remarks the size of the file is taken when it's appended, the file must not be modified until the body has been sent
+	/// \remarks the file must not be truncated while it is sent: the check making the body fail with an error is only
+	/// best-effort on a mapped file, a truncation during a copy from the mapping still crashes the process (SIGBUS)
+	///
+	////////////////////////////////////////////////////////////
+	bool appendFile( const QString & path, PartDigest * digest = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// append a digest of the last file appended, in hexadecimal
+	///
+	/// \param algorithm : an algorithm computed by the digest given with the file
+	/// \param prefix : the data preceding the digest
+	/// \param suffix : the data following the digest
+	///
+	/// \remarks the digest is computed while the file is read, the file is read again only if it hasn't been read entirely in order before
+	///
+	////////////////////////////////////////////////////////////
+	void appendDigest( PartDigest::Algorithm algorithm, const QByteArray & prefix, const QByteArray & suffix );
+	
+	////////////////////////////////////////////////////////////
+	/// append the content of another device to the body
+	///
+	/// \param device : an opened device, it must stay valid until the body has been sent
+	/// \param size : the number of bytes to read from the device, or -1 to read it until its end
+	///
+	/// \remarks when the device is sequential or its size is unknown, the body becomes sequential
+	/// \remarks the end of a sequential device of unknown size is reached when read() returns -1 or readChannelFinished() has been emitted
+	///
+	////////////////////////////////////////////////////////////
+	void appendDevice( QIODevice * device, qint64 size = -1 );
+	
+	////////////////////////////////////////////////////////////
+	/// get the time spent opening and reading the files, in nanoseconds
+	///
+	////////////////////////////////////////////////////////////
+	qint64 fileReadTime() const;
+	
+	bool isSequential() const;
+	qint64 size() const;
+	bool atEnd() const;
+	bool seek( qint64 pos );
+	void close();
+
+protected:
+	qint64 readData( char * data, qint64 maxSize );
+	qint64 writeData( const char * data, qint64 maxSize );
+
+private:
+	struct Part
+	{
+		Part() : device( 0 ), start( 0 ), size( 0 ), hashed( 0 ), digestSource( -1 ), digestAlgorithm( 0 ), digestOffset( 0 ), digestWritten( false ) {}
+		
+		QByteArray data;
+		QString path;
+		QIODevice * device;
+		qint64 start;
+		qint64 size;
+		
+		// a file hashed while it is read, from its beginning
+		QSharedPointer< PartDigest > digest;
+		qint64 hashed;
+		
+		// the digest of a file written in data at digestOffset when the part is reached
+		int digestSource;
+		int digestAlgorithm;
+		int digestOffset;
+		bool digestWritten;
+	};
+	
+	QList< Part > m_parts;
+	QSharedPointer< PartDigest > m_lastDigest;
+	int m_lastDigestSource;
+	qint64 m_size;
+	bool m_sizeKnown;
+	bool m_sequential;
+	QSet< QIODevice * > m_finishedDevices;
+	int m_part;
+	qint64 m_partOffset;
+	QFile m_file;
+	uchar * m_map;
+	qint64 m_fileReadTime;
+	
+	bool openFile( const Part & part );
+	void closeFile();
+	void nextPart();
+	void rewindDevice();
+	bool writeDigest( Part & part );
+	bool deviceAtEnd( QIODevice * device ) const;
+
+private slots:
+	void deviceFinished();
+};
+
+#endif
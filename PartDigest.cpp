@@ -0,0 +1,266 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "PartDigest.h"
+
+#include <QFile>
+#include <cstring>
+
+#if ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define SEND_FORM_CRC32C_SSE42
+#define SEND_FORM_SSE42_FUNCTION __attribute__(( target( "sse4.2" ) ))
+#include <nmmintrin.h>
+#elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#define SEND_FORM_CRC32C_SSE42
+#define SEND_FORM_SSE42_FUNCTION
+#include <intrin.h>
+#include <nmmintrin.h>
+#endif
+
+// size of the chunks a file is read by
+static const int fileChunkSize = 256 * 1024;
+
+////////////////////////////////////////////////////////////
+/// CRC-32C of each byte value, for the processors without SSE 4.2
+////////////////////////////////////////////////////////////
+struct Crc32cTable
+{
+	quint32 values[256];
+	
+	Crc32cTable()
+	{
+		// reflected Castagnoli polynomial
+		for(quint32 i = 0;i < 256;i++)
+		{
+			quint32 crc = i;
+			for(int bit = 0;bit < 8;bit++)
+			{
+				crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? 0x82F63B78 : 0 );
+			}
+			values[i] = crc;
+		}
+	}
+};
+
+static const Crc32cTable crc32cTable;
+
+static quint32 crc32cSoftware( quint32 crc, const uchar * data, qint64 size )
+{
+	for(qint64 i = 0;i < size;i++)
+	{
+		crc = crc32cTable.values[ ( crc ^ data[i] ) & 0xFF ] ^ ( crc >> 8 );
+	}
+	
+	return crc;
+}
+
+#ifdef SEND_FORM_CRC32C_SSE42
+////////////////////////////////////////////////////////////
+/// the processor computes the CRC 8 (or 4) bytes at a time
+////////////////////////////////////////////////////////////
+SEND_FORM_SSE42_FUNCTION static quint32 crc32cHardware( quint32 crc, const uchar * data, qint64 size )
+{
+	qint64 i = 0;
+	
+#if defined( __x86_64__ ) || defined( _M_X64 )
+	quint64 crc64 = crc;
+	for(;i + 8 <= size;i += 8)
+	{
+		quint64 value;
+		std::memcpy( &value, data + i, 8 );
+		crc64 = _mm_crc32_u64( crc64, value );
+	}
+	crc = quint32( crc64 );
+#else
+	for(;i + 4 <= size;i += 4)
+	{
+		quint32 value;
+		std::memcpy( &value, data + i, 4 );
+		crc = _mm_crc32_u32( crc, value );
+	}
+#endif
+	
+	for(;i < size;i++)
+	{
+		crc = _mm_crc32_u8( crc, data[i] );
+	}
+	
+	return crc;
+}
+
+static bool hasSse42()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+	return ( info[2] & ( 1 << 20 ) ) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "sse4.2" );
+#endif
+}
+
+// checked once, when the library is loaded
+static const bool hardwareCrc32c = hasSse42();
+#endif
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+PartDigest::PartDigest( int algorithms )
+{
+#if QT_VERSION < 0x050000
+	algorithms &= ~Sha256;
+#endif
+	
+	m_algorithms = algorithms;
+	m_crc = 0;
+	m_md5 = algorithms & Md5 ? new QCryptographicHash( QCryptographicHash::Md5 ) : 0;
+	m_sha1 = algorithms & Sha1 ? new QCryptographicHash( QCryptographicHash::Sha1 ) : 0;
+#if QT_VERSION >= 0x050000
+	m_sha256 = algorithms & Sha256 ? new QCryptographicHash( QCryptographicHash::Sha256 ) : 0;
+#else
+	m_sha256 = 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// Destructor
+////////////////////////////////////////////////////////////
+PartDigest::~PartDigest()
+{
+	delete m_md5;
+	delete m_sha1;
+	delete m_sha256;
+}
+
+int PartDigest::algorithms() const
+{
+	return m_algorithms;
+}
+
+////////////////////////////////////////////////////////////
+/// forget the data added so far
+////////////////////////////////////////////////////////////
+void PartDigest::reset()
+{
+	m_crc = 0;
+	if( m_md5 ) m_md5->reset();
+	if( m_sha1 ) m_sha1->reset();
+	if( m_sha256 ) m_sha256->reset();
+}
+
+////////////////////////////////////////////////////////////
+/// add some data to the digests
+////////////////////////////////////////////////////////////
+void PartDigest::addData( const char * data, qint64 size )
+{
+	if( m_algorithms & Crc32c ) m_crc = crc32c( m_crc, data, size );
+	
+	// QCryptographicHash takes an int size
+	for(qint64 done = 0;done < size;)
+	{
+		int chunk = int( qMin( size - done, qint64( 1 << 30 ) ) );
+		if( m_md5 ) m_md5->addData( data + done, chunk );
+		if( m_sha1 ) m_sha1->addData( data + done, chunk );
+		if( m_sha256 ) m_sha256->addData( data + done, chunk );
+		done += chunk;
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// add the whole content of a file to the digests
+////////////////////////////////////////////////////////////
+bool PartDigest::addFile( const QString & path )
+{
+	QFile file( path );
+	if( !file.open( QIODevice::ReadOnly | QIODevice::Unbuffered ) ) return false;
+	
+	QByteArray chunk( fileChunkSize, Qt::Uninitialized );
+	for(;;)
+	{
+		qint64 read = file.read( chunk.data(), chunk.size() );
+		if( read < 0 ) return false;
+		if( read == 0 ) return true;
+		
+		addData( chunk.constData(), read );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// get a digest of the data added so far
+////////////////////////////////////////////////////////////
+QByteArray PartDigest::result( Algorithm algorithm ) const
+{
+	switch( algorithm )
+	{
+		case Crc32c:
+		{
+			// big-endian, like it is usually printed
+			char bytes[4] = { char( m_crc >> 24 ), char( m_crc >> 16 ), char( m_crc >> 8 ), char( m_crc ) };
+			return QByteArray( bytes, 4 );
+		}
+		case Md5:
+			return m_md5 ? m_md5->result() : QByteArray();
+		case Sha1:
+			return m_sha1 ? m_sha1->result() : QByteArray();
+		case Sha256:
+			return m_sha256 ? m_sha256->result() : QByteArray();
+	}
+	
+	return QByteArray();
+}
+
+int PartDigest::resultSize( Algorithm algorithm )
+{
+	switch( algorithm )
+	{
+		case Crc32c: return 4;
+		case Md5: return 16;
+		case Sha1: return 20;
+		case Sha256: return 32;
+	}
+	
+	return 0;
+}
+
+const char * PartDigest::name( Algorithm algorithm )
+{
+	switch( algorithm )
+	{
+		case Crc32c: return "crc32c";
+		case Md5: return "md5";
+		case Sha1: return "sha1";
+		case Sha256: return "sha256";
+	}
+	
+	return "";
+}
+
+////////////////////////////////////////////////////////////
+/// update a CRC-32C
+////////////////////////////////////////////////////////////
+quint32 PartDigest::crc32c( quint32 crc, const char * data, qint64 size )
+{
+	const uchar * bytes = reinterpret_cast< const uchar * >( data );
+	
+#ifdef SEND_FORM_CRC32C_SSE42
+	if( hardwareCrc32c ) return ~crc32cHardware( ~crc, bytes, size );
+#endif
+	
+	return ~crc32cSoftware( ~crc, bytes, size );
+}
@@ -0,0 +1,129 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_PART_DIGEST
+#define SEND_FORM_PART_DIGEST
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QString>
+
+////////////////////////////////////////////////////////////
+/// PartDigest computes several digests of a part in a single pass.
+///
+/// CRC-32C uses the SSE 4.2 instruction when the processor has it, a table otherwise.
+/// SHA-256 needs Qt 5, it is ignored with Qt 4.
+////////////////////////////////////////////////////////////
+class PartDigest
+{
+public:
+	enum Algorithm
+	{
+		Crc32c = 0x1,	///< CRC-32C (Castagnoli), 4 bytes
+		Md5 = 0x2,		///< MD5, 16 bytes
+		Sha1 = 0x4,		///< SHA-1, 20 bytes
+		Sha256 = 0x8	///< SHA-256, 32 bytes
+	};
+	
+	enum { AlgorithmCount = 4 };
+	
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param algorithms : the algorithms to compute (combination of Algorithm)
+	///
+	////////////////////////////////////////////////////////////
+	PartDigest( int algorithms );
+	
+	////////////////////////////////////////////////////////////
+	/// Destructor
+	///
+	////////////////////////////////////////////////////////////
+	~PartDigest();
+	
+	////////////////////////////////////////////////////////////
+	/// get the algorithms computed (the ones given to the constructor that are available)
+	///
+	////////////////////////////////////////////////////////////
+	int algorithms() const;
+	
+	////////////////////////////////////////////////////////////
+	/// forget the data added so far
+	///
+	////////////////////////////////////////////////////////////
+	void reset();
+	
+	////////////////////////////////////////////////////////////
+	/// add some data to the digests
+	///
+	/// \param data : the data
+	/// \param size : the number of bytes
+	///
+	////////////////////////////////////////////////////////////
+	void addData( const char * data, qint64 size );
+	
+	////////////////////////////////////////////////////////////
+	/// add the whole content of a file to the digests
+	///
+	/// \param path : the file path
+	///
+	/// \return false if the file can't be read
+	///
+	////////////////////////////////////////////////////////////
+	bool addFile( const QString & path );
+	
+	////////////////////////////////////////////////////////////
+	/// get a digest of the data added so far
+	///
+	/// \param algorithm : an algorithm being computed
+	///
+	////////////////////////////////////////////////////////////
+	QByteArray result( Algorithm algorithm ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the size of a digest, in bytes
+	///
+	////////////////////////////////////////////////////////////
+	static int resultSize( Algorithm algorithm );
+	
+	////////////////////////////////////////////////////////////
+	/// get the lower case name of an algorithm ("crc32c", "md5", "sha1", "sha256")
+	///
+	////////////////////////////////////////////////////////////
+	static const char * name( Algorithm algorithm );
+	
+	////////////////////////////////////////////////////////////
+	/// update a CRC-32C
+	///
+	/// \param crc : the CRC of the previous data, 0 for the first data
+	/// \param data : the data
+	/// \param size : the number of bytes
+	///
+	////////////////////////////////////////////////////////////
+	static quint32 crc32c( quint32 crc, const char * data, qint64 size );
+
+private:
+	Q_DISABLE_COPY( PartDigest )
+	
+	int m_algorithms;
+	quint32 m_crc;
+	QCryptographicHash * m_md5;
+	QCryptographicHash * m_sha1;
+	QCryptographicHash * m_sha256;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "ReadAheadDevice.h"
+
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <cstring>
+
+// size of the chunks read on the pool
+static const int chunkSize = 256 * 1024;
+
+// number of bytes read in advance before waiting for the reader
+static const qint64 readAheadSize = 4 * chunkSize;
+
+////////////////////////////////////////////////////////////
+/// state shared by the device and the chunks being read,
+/// the source is destroyed by the last one finishing
+////////////////////////////////////////////////////////////
+struct ReadAheadState
+{
+	QMutex mutex;
+	QIODevice * source;
+	ReadAheadDevice * target;
+	
+	~ReadAheadState()
+	{
+		delete source;
+	}
+};
+
+////////////////////////////////////////////////////////////
+/// read the next chunk of the source and give it to the device
+////////////////////////////////////////////////////////////
+class ReadAheadTask : public QRunnable
+{
+public:
+	ReadAheadTask( const QSharedPointer< ReadAheadState > & state ) : m_state( state )
+	{
+	}
+	
+	void run()
+	{
+		// the device waits on the mutex when it is destroyed during the read
+		QMutexLocker locker( &m_state->mutex );
+		if( !m_state->target ) return;
+		
+		QIODevice * source = m_state->source;
+		QByteArray chunk( chunkSize, Qt::Uninitialized );
+		
+		QElapsedTimer timer;
+		timer.start();
+		qint64 read = source->read( chunk.data(), chunkSize );
+		qint64 readTime = timer.nsecsElapsed();
+		
+		// -1 before the end of the source is an error
+		QString error;
+		if( read < 0 && !source->atEnd() ) error = source->errorString();
+		bool end = read < 0 || source->atEnd();
+		chunk.resize( read < 0 ? 0 : int( read ) );
+		
+		// the call is dropped if the device is destroyed before it is delivered
+		QMetaObject::invokeMethod( m_state->target, "chunkRead", Qt::QueuedConnection, Q_ARG( QByteArray, chunk ), Q_ARG( bool, end ), Q_ARG( QString, error ), Q_ARG( qint64, readTime ) );
+	}
+
+private:
+	QSharedPointer< ReadAheadState > m_state;
+};
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+ReadAheadDevice::ReadAheadDevice( QIODevice * source, qint64 size, QThreadPool * pool, QObject * parent ) : QIODevice( parent ), m_state( new ReadAheadState )
+{
+	m_state->source = source;
+	m_state->target = this;
+	m_pool = pool;
+	m_size = size;
+	m_chunkOffset = 0;
+	m_buffered = 0;
+	m_sourceReadTime = 0;
+	m_reading = false;
+	m_sourceEnd = false;
+	m_sourceFailed = false;
+}
+
+////////////////////////////////////////////////////////////
+/// Destructor
+////////////////////////////////////////////////////////////
+ReadAheadDevice::~ReadAheadDevice()
+{
+	QMutexLocker locker( &m_state->mutex );
+	m_state->target = 0;
+}
+
+////////////////////////////////////////////////////////////
+/// get the time spent by the pool reading the source
+////////////////////////////////////////////////////////////
+qint64 ReadAheadDevice::sourceReadTime() const
+{
+	return m_sourceReadTime;
+}
+
+////////////////////////////////////////////////////////////
+/// start reading the source
+////////////////////////////////////////////////////////////
+bool ReadAheadDevice::open( OpenMode mode )
+{
+	if( mode & QIODevice::WriteOnly ) return false;
+	if( !QIODevice::open( mode ) ) return false;
+	
+	scheduleRead();
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// the chunks can only be read once
+////////////////////////////////////////////////////////////
+bool ReadAheadDevice::isSequential() const
+{
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// the size given to the constructor
+////////////////////////////////////////////////////////////
+qint64 ReadAheadDevice::size() const
+{
+	return m_size;
+}
+
+////////////////////////////////////////////////////////////
+/// the bytes of the chunks already read
+////////////////////////////////////////////////////////////
+qint64 ReadAheadDevice::bytesAvailable() const
+{
+	return m_buffered - m_chunkOffset + QIODevice::bytesAvailable();
+}
+
+////////////////////////////////////////////////////////////
+/// the source has been read entirely and all its chunks have been given, a read error doesn't end it
+////////////////////////////////////////////////////////////
+bool ReadAheadDevice::atEnd() const
+{
+	return m_sourceEnd && !m_sourceFailed && bytesAvailable() == 0;
+}
+
+////////////////////////////////////////////////////////////
+/// give the chunks already read
+////////////////////////////////////////////////////////////
+qint64 ReadAheadDevice::readData( char * data, qint64 maxSize )
+{
+	// the body would be sent cut, the chunks left are dropped so the reader sees the error
+	if( m_sourceFailed ) return -1;
+	
+	qint64 total = 0;
+	while( total < maxSize && !m_chunks.isEmpty() )
+	{
+		const QByteArray & chunk = m_chunks.head();
+		qint64 count = qMin( maxSize - total, qint64( chunk.size() - m_chunkOffset ) );
+		std::memcpy( data + total, chunk.constData() + m_chunkOffset, count );
+		total += count;
+		m_chunkOffset += int( count );
+		
+		if( m_chunkOffset == chunk.size() )
+		{
+			m_buffered -= chunk.size();
+			m_chunkOffset = 0;
+			m_chunks.dequeue();
+		}
+	}
+	
+	scheduleRead();
+	
+	if( total == 0 && m_sourceEnd && m_chunks.isEmpty() ) return -1;
+	return total;
+}
+
+////////////////////////////////////////////////////////////
+/// the device is read only
+////////////////////////////////////////////////////////////
+qint64 ReadAheadDevice::writeData( const char *, qint64 )
+{
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+/// a chunk has been read on the pool
+////////////////////////////////////////////////////////////
+void ReadAheadDevice::chunkRead( const QByteArray & chunk, bool end, const QString & error, qint64 readTime )
+{
+	m_reading = false;
+	m_sourceReadTime += readTime;
+	
+	if( !error.isEmpty() )
+	{
+		setErrorString( error );
+		m_sourceFailed = true;
+		m_chunks.clear();
+		m_chunkOffset = 0;
+		m_buffered = 0;
+	}
+	if( end || !error.isEmpty() ) m_sourceEnd = true;
+	
+	if( !chunk.isEmpty() && !m_sourceFailed )
+	{
+		m_chunks.enqueue( chunk );
+		m_buffered += chunk.size();
+	}
+	
+	scheduleRead();
+	
+	if( !chunk.isEmpty() || m_sourceEnd ) emit readyRead();
+	if( m_sourceEnd ) emit readChannelFinished();
+}
+
+////////////////////////////////////////////////////////////
+/// read the next chunk if there is room for it
+////////////////////////////////////////////////////////////
+void ReadAheadDevice::scheduleRead()
+{
+	if( m_reading || m_sourceEnd || m_buffered >= readAheadSize || !isOpen() ) return;
+	
+	m_reading = true;
+	m_pool->start( new ReadAheadTask( m_state ) );
+}
@@ -0,0 +1,98 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_READ_AHEAD_DEVICE
+#define SEND_FORM_READ_AHEAD_DEVICE
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QString>
+#include <QThreadPool>
+
+struct ReadAheadState;
+
+////////////////////////////////////////////////////////////
+/// ReadAheadDevice reads another device by chunks on a thread pool.
+///
+/// The chunks are handed to the reader from the thread owning the device,
+/// which never waits for the source: when no chunk is ready, nothing is read
+/// and readyRead() is emitted as soon as one arrives. A read error of the source
+/// is given to the reader at once: read() returns -1 while atEnd() is false.
+////////////////////////////////////////////////////////////
+class ReadAheadDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param source : the opened device to read, the ReadAheadDevice takes its ownership and it must not be used anymore
+	/// \param size : the number of bytes the source will give, or -1 if it is unknown
+	/// \param pool : the pool reading the source
+	/// \param parent : the parent of the device
+	///
+	/// \remarks the source is read by one thread of the pool at a time, so it must not use signals or timers
+	///
+	////////////////////////////////////////////////////////////
+	ReadAheadDevice( QIODevice * source, qint64 size, QThreadPool * pool, QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// Destructor
+	///
+	/// \remarks waits for the chunk being read, if any
+	///
+	////////////////////////////////////////////////////////////
+	~ReadAheadDevice();
+	
+	////////////////////////////////////////////////////////////
+	/// get the time spent by the pool reading the source, in nanoseconds
+	///
+	////////////////////////////////////////////////////////////
+	qint64 sourceReadTime() const;
+	
+	bool open( OpenMode mode );
+	bool isSequential() const;
+	qint64 size() const;
+	qint64 bytesAvailable() const;
+	bool atEnd() const;
+
+protected:
+	qint64 readData( char * data, qint64 maxSize );
+	qint64 writeData( const char * data, qint64 maxSize );
+
+private slots:
+	void chunkRead( const QByteArray & chunk, bool end, const QString & error, qint64 readTime );
+
+private:
+	QSharedPointer< ReadAheadState > m_state;
+	QThreadPool * m_pool;
+	qint64 m_size;
+	QQueue< QByteArray > m_chunks;
+	int m_chunkOffset;
+	qint64 m_buffered;
+	qint64 m_sourceReadTime;
+	bool m_reading;
+	bool m_sourceEnd;
+	bool m_sourceFailed;
+	
+	void scheduleRead();
+};
+
+#endif
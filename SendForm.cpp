@@ -16,23 +16,139 @@
 * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 ******************************************************************************/
 #include "SendForm.h"
+#include "BodySpool.h"
+#include "CompressedBodyDevice.h"
+#include "ContentSniffer.h"
+#include "ContinueGateDevice.h"
+#include "FormUrlEncoder.h"
+#include "MultipartBodyDevice.h"
+#include "SendFormAsyncPost.h"
+#include "SendFormStats.h"
+#include "ThrottledBodyDevice.h"
 
+#include <QAtomicInt>
+#include <QBuffer>
+#include <QDateTime>
 #include <QFile>
 #include <QFileInfo>
-#include <QHashIterator>
-#include <ctime>
+#include <QRunnable>
+#ifndef QT_NO_SSL
+#include <QSslConfiguration>
+#endif
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
+
+////////////////////////////////////////////////////////////
+/// the entries are views on a buffer, so their size must be given
+////////////////////////////////////////////////////////////
+static inline QString fromUtf8( const QByteArray & utf8 )
+{
+	return QString::fromUtf8( utf8.constData(), utf8.size() );
+}
+
+////////////////////////////////////////////////////////////
+/// "Content-MD5" (RFC 1864) and "Digest" (RFC 3230) headers of a part
+////////////////////////////////////////////////////////////
+static QByteArray digestHeaderLines( const PartDigest & digest )
+{
+	QByteArray lines;
+	if( digest.algorithms() & PartDigest::Md5 )
+	{
+		lines += "Content-MD5: " + digest.result( PartDigest::Md5 ).toBase64() + "\r\n";
+	}
+	
+	QList< QByteArray > values;
+	if( digest.algorithms() & PartDigest::Crc32c ) values.append( "crc32c=" + digest.result( PartDigest::Crc32c ).toHex() );
+	if( digest.algorithms() & PartDigest::Md5 ) values.append( "md5=" + digest.result( PartDigest::Md5 ).toBase64() );
+	if( digest.algorithms() & PartDigest::Sha1 ) values.append( "sha=" + digest.result( PartDigest::Sha1 ).toBase64() );
+	if( digest.algorithms() & PartDigest::Sha256 ) values.append( "sha-256=" + digest.result( PartDigest::Sha256 ).toBase64() );
+	
+	if( !values.isEmpty() )
+	{
+		lines += "Digest: ";
+		for(int i = 0;i < values.count();i++)
+		{
+			if( i ) lines += ',';
+			lines += values[i];
+		}
+		lines += "\r\n";
+	}
+	
+	return lines;
+}
 
 ////////////////////////////////////////////////////////////
 /// Constructor
 ////////////////////////////////////////////////////////////
 SendForm::SendForm( const QUrl & destination )
 {
-	if( !m_initialized ) init();
-	
+	m_destination = destination;
 	m_request.setUrl( destination );
 	setReferer( destination.host() );
 	
 	m_forcemultipart = false;
+	m_compressionLevel = 0;
+	m_compression = Gzip;
+	m_memoryBudget = 4 * 1024 * 1024;
+	m_expectContinue = false;
+	m_continueTimeout = 1000;
+	m_uploadScheduler = 0;
+	m_uploadWeight = 1;
+	m_digests = 0;
+	m_digestPlacement = DigestFields;
+	m_contentSniffing = false;
+	m_statsEnabled = false;
+	m_statsCollector = 0;
+}
+
+////////////////////////////////////////////////////////////
+/// open a connection to the destination and create a form to copy for each post to it
+////////////////////////////////////////////////////////////
+SendForm SendForm::prepare( QNetworkAccessManager * manager, const QUrl & destination, bool http2 )
+{
+	SendForm form( destination );
+	if( http2 ) form.setHttp2( true );
+	
+#if QT_VERSION >= 0x050200
+	// the DNS lookup, the TCP handshake and the TLS one are done while the first form is filled,
+	// on a connection of the same kind as the posts, or they would open another one
+	if( destination.scheme() == "https" )
+	{
+#ifndef QT_NO_SSL
+		QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+		bool reusable = !http2;
+		
+#if QT_VERSION >= 0x050F00
+		// the connection is only kept for the HTTP/2 requests if it offers h2 to the server
+		if( http2 )
+		{
+			configuration.setAllowedNextProtocols( QList< QByteArray >() << QSslConfiguration::ALPNProtocolHTTP2 << QSslConfiguration::NextProtocolHttp1_1 );
+			reusable = true;
+		}
+#endif
+		
+		if( reusable ) manager->connectToHostEncrypted( destination.host(), destination.port( 443 ), configuration );
+#endif
+	}
+	else if( destination.scheme() == "http" && !http2 )
+	{
+		manager->connectToHost( destination.host(), destination.port( 80 ) );
+	}
+#else
+	Q_UNUSED( manager );
+#endif
+	
+	return form;
+}
+
+////////////////////////////////////////////////////////////
+/// get the url that will receive the form
+////////////////////////////////////////////////////////////
+const QUrl & SendForm::destination() const
+{
+	return m_destination;
 }
 
 ////////////////////////////////////////////////////////////
@@ -40,7 +156,7 @@ SendForm::SendForm( const QUrl & destination )
 ////////////////////////////////////////////////////////////
 void SendForm::addFile( const QString & name, const QString & file )
 {
-	m_files[ name ] = file;
+	m_files.append( name, file );
 }
 
 ////////////////////////////////////////////////////////////
@@ -55,12 +171,92 @@ void SendForm::addFiles( const QStringList & names, const QStringList & files )
 	}
 }
 
+////////////////////////////////////////////////////////////
+/// add a field "file" whose content is read from a device
+////////////////////////////////////////////////////////////
+void SendForm::addDevice( const QString & name, QIODevice * device, const QString & filename, const QByteArray & mime, qint64 size )
+{
+	Device part;
+	part.name = name;
+	part.device = device;
+	part.filename = filename;
+	part.mime = mime;
+	part.size = size;
+	
+	m_devices.append( part );
+}
+
+////////////////////////////////////////////////////////////
+/// add a field "file" whose content is in memory
+////////////////////////////////////////////////////////////
+void SendForm::addData( const QString & name, const QByteArray & data, const QString & filename, const QByteArray & mime )
+{
+	Data part;
+	part.name = name;
+	part.data = data;
+	part.filename = filename;
+	part.mime = mime;
+	
+	m_data.append( part );
+}
+
+#ifdef Q_COMPILER_RVALUE_REFS
+////////////////////////////////////////////////////////////
+/// add a field "file" whose content is in memory, taking the ownership of the data
+////////////////////////////////////////////////////////////
+void SendForm::addData( const QString & name, QByteArray && data, const QString & filename, const QByteArray & mime )
+{
+	Data part;
+	part.name = name;
+	part.data.swap( data );
+	part.filename = filename;
+	part.mime = mime;
+	
+	m_data.append( part );
+}
+#endif
+
 ////////////////////////////////////////////////////////////
 /// add a field to the form
 ////////////////////////////////////////////////////////////
 void SendForm::addField( const QString & name, const QString & value )
 {
-	m_fields[ name ] = value;
+	m_fields.append( name, value );
+	m_urlEncodedCache.clear();
+}
+
+////////////////////////////////////////////////////////////
+/// add a field already encoded in UTF-8
+////////////////////////////////////////////////////////////
+void SendForm::addField( const QByteArray & name, const QByteArray & value )
+{
+	m_fields.append( name, value );
+	m_urlEncodedCache.clear();
+}
+
+////////////////////////////////////////////////////////////
+/// literals would be ambiguous between the QString and QByteArray overloads
+////////////////////////////////////////////////////////////
+void SendForm::addField( const char * name, const char * value )
+{
+	addField( QByteArray::fromRawData( name, int( qstrlen( name ) ) ), QByteArray::fromRawData( value, int( qstrlen( value ) ) ) );
+}
+
+////////////////////////////////////////////////////////////
+/// set the value of a field, replacing all its previous values
+////////////////////////////////////////////////////////////
+void SendForm::setField( const QString & name, const QString & value )
+{
+	m_fields.set( name, value );
+	m_urlEncodedCache.clear();
+}
+
+////////////////////////////////////////////////////////////
+/// reserve room for the fields
+////////////////////////////////////////////////////////////
+void SendForm::reserveFields( int count, int bytes )
+{
+	m_fields.reserve( count, bytes );
 }
 
 ////////////////////////////////////////////////////////////
@@ -80,7 +276,7 @@ void SendForm::addFields( const QStringList & names, const QStringList & values
 ////////////////////////////////////////////////////////////
 void SendForm::setReferer( const QString & url )
 {
-	m_request.setRawHeader( "Referer", url.toAscii() );
+	m_request.setRawHeader( "Referer", url.toLatin1() );
 }
 
 ////////////////////////////////////////////////////////////
@@ -114,6 +310,9 @@ void SendForm::clear()
 void SendForm::clearFiles()
 {
 	m_files.clear();
+	m_devices.clear();
+	m_data.clear();
+	m_fileCache.clear();
 }
 
 ////////////////////////////////////////////////////////////
@@ -122,6 +321,51 @@ void SendForm::clearFiles()
 void SendForm::clearFields()
 {
 	m_fields.clear();
+	m_urlEncodedCache.clear();
+}
+
+////////////////////////////////////////////////////////////
+/// compute the size of the body post() would send
+////////////////////////////////////////////////////////////
+qint64 SendForm::plannedSize() const
+{
+	if( !isMultipart() )
+	{
+		return urlEncodedBody().size();
+	}
+	
+	qint64 size = 0;
+	
+	for(int i = 0;i < m_files.count();i++)
+	{
+		QFileInfo fi( fromUtf8( m_files.value( i ) ) );
+		if( fi.isFile() && fi.isReadable() )
+		{
+			// the header is the one post() sends, with a sniffed type it costs a read of the beginning of the file
+			size += cachedFileHeader( m_files.name( i ), fi ).size() + fi.size() + 2 + digestSize( m_files.name( i ) );
+		}
+	}
+	
+	foreach( const Data & part, m_data )
+	{
+		size += partHeader( boundary(), part.name, part.filename, part.mime ).size() + part.data.size() + 2 + digestSize( part.name.toUtf8() );
+	}
+	
+	foreach( const Device & part, m_devices )
+	{
+		qint64 deviceSize = part.bodySize();
+		if( deviceSize < 0 ) return -1;
+		
+		size += partHeader( boundary(), part.name, part.filename, part.mime ).size() + deviceSize + 2;
+	}
+	
+	for(int i = 0;i < m_fields.count();i++)
+	{
+		const QByteArray & cached = m_fields.encoded( i );
+		size += cached.isNull() ? fieldPart( boundary(), m_fields.name( i ), m_fields.value( i ) ).size() : cached.size();
+	}
+	
+	return size + closingBoundary( boundary() ).size();
 }
 
 ////////////////////////////////////////////////////////////
@@ -129,68 +373,738 @@ void SendForm::clearFields()
 ////////////////////////////////////////////////////////////
 QNetworkReply * SendForm::post( QNetworkAccessManager * manager )
 {
-	QByteArray boundary = generateBoundary();
+	SendFormStats * stats = createStats();
+	
+	qint64 length;
+	MultipartBodyDevice * multipart;
+	QIODevice * body = prepareBody( length, stats, &multipart );
+	if( !body )
+	{
+		delete stats;
+		return 0;
+	}
+	
+	return send( manager, body, length, stats, multipart );
+}
+
+////////////////////////////////////////////////////////////
+/// send the form, the files being opened and read on a thread pool
+////////////////////////////////////////////////////////////
+SendFormAsyncPost * SendForm::postAsync( QNetworkAccessManager * manager, QThreadPool * pool )
+{
+	SendFormAsyncPost * post = new SendFormAsyncPost( *this, manager, pool ? pool : QThreadPool::globalInstance() );
+	post->start();
+	return post;
+}
+
+////////////////////////////////////////////////////////////
+/// create the statistics of a request if they are wanted
+////////////////////////////////////////////////////////////
+SendFormStats * SendForm::createStats() const
+{
+	if( !m_statsEnabled && !m_statsCollector ) return 0;
+	
+	SendFormStats * stats = new SendFormStats;
+	stats->start();
+	return stats;
+}
+
+////////////////////////////////////////////////////////////
+/// create the body to send (compressed if needed) and set the headers describing it,
+/// 0 if a file can't be read or the body couldn't be spooled
+////////////////////////////////////////////////////////////
+QIODevice * SendForm::prepareBody( qint64 & length, SendFormStats * stats, MultipartBodyDevice ** multipart, MultipartBodyDevice * parts )
+{
+	QIODevice * body = createBody( length, stats ? &stats->m_partSizes : 0, parts );
+	if( multipart ) *multipart = qobject_cast< MultipartBodyDevice * >( body );
+	if( !body ) return 0;
 	
-	QByteArray temp_data;
+	if( m_compressionLevel )
+	{
+		// the compressed size is only known once everything has been compressed
+		CompressedBodyDevice * compressed = new CompressedBodyDevice( body, m_compressionLevel, m_compression == Deflate ? CompressedBodyDevice::Deflate : CompressedBodyDevice::Gzip );
+		body->setParent( compressed );
+		compressed->open( QIODevice::ReadOnly );
+		
+		m_request.setRawHeader( "Content-Encoding", compressed->contentEncoding() );
+		
+		body = compressed;
+		length = -1;
+	}
+	else
+	{
+		m_request.setRawHeader( "Content-Encoding", QByteArray() );
+	}
 	
-	QHashIterator< QString, QString > i( m_files );
-	while( i.hasNext() )
+	if( length < 0 && canSpool() )
+	{
+		// QNetworkAccessManager would read the whole body in memory to know its length,
+		// so it is read here, in memory within the budget and in a temporary file beyond
+		MultipartBodyDevice * source = multipart ? *multipart : 0;
+		QIODevice * spooled = BodySpool::spool( body, m_memoryBudget, length );
+		
+		if( stats && source ) stats->m_fileReadTime = source->fileReadTime() / 1000;
+		if( multipart ) *multipart = 0;
+		
+		delete body;
+		body = spooled;
+		
+		// a body that couldn't be read entirely isn't sent truncated
+		if( !body ) return 0;
+	}
+	
+	if( stats )
+	{
+		stats->m_encodingTime = stats->now();
+		stats->m_totalBytes = length;
+	}
+	
+	return body;
+}
+
+////////////////////////////////////////////////////////////
+/// issue the request with a body created by prepareBody()
+////////////////////////////////////////////////////////////
+QNetworkReply * SendForm::send( QNetworkAccessManager * manager, QIODevice * body, qint64 length, SendFormStats * stats, MultipartBodyDevice * multipart )
+{
+	// the scheduler is outside the gate, tokens aren't taken while the body is held back
+	if( m_uploadScheduler && length >= 0 )
 	{
-		i.next();
-		QFile file( i.value() );
-		if( file.open( QIODevice::ReadOnly ) )
+		ThrottledBodyDevice * throttled = new ThrottledBodyDevice( body, m_uploadScheduler, m_destination.host(), m_uploadWeight );
+		throttled->open( QIODevice::ReadOnly );
+		body = throttled;
+	}
+	
+	ContinueGateDevice * gate = 0;
+	if( m_expectContinue && length > 0 )
+	{
+		gate = new ContinueGateDevice( body, m_continueTimeout );
+		gate->open( QIODevice::ReadOnly );
+		body = gate;
+		
+		m_request.setRawHeader( "Expect", "100-continue" );
+	}
+	else
+	{
+		m_request.setRawHeader( "Expect", QByteArray() );
+	}
+	
+	if( length < 0 )
+	{
+		// QNetworkAccessManager can't send a request body without its length,
+		// so it reads the whole body before sending it
+		m_request.setRawHeader( "Content-Length", QByteArray() );
+		m_request.setAttribute( QNetworkRequest::DoNotBufferUploadDataAttribute, false );
+	}
+	else
+	{
+		// a sequential body of known size can be streamed
+		m_request.setRawHeader( "Content-Length", QByteArray::number( length ) );
+		m_request.setAttribute( QNetworkRequest::DoNotBufferUploadDataAttribute, body->isSequential() );
+	}
+	
+	// the body is destroyed with the reply
+	QNetworkReply * reply = manager->post( m_request, body );
+	body->setParent( reply );
+	
+	if( gate ) gate->watch( reply );
+	if( stats ) stats->attach( reply, multipart, m_statsCollector );
+	
+	return reply;
+}
+
+////////////////////////////////////////////////////////////
+/// create a multipart body holding the files and the in-memory data, the devices and the fields are appended by createBody(),
+/// 0 if a file can't be read
+////////////////////////////////////////////////////////////
+MultipartBodyDevice * SendForm::createParts( QList< QPair< QString, qint64 > > * partSizes ) const
+{
+	QByteArray boundary = this->boundary();
+	
+	// the files are only read when the network layer asks for their content
+	MultipartBodyDevice * body = new MultipartBodyDevice;
+	
+	// the digests sent in the headers must be known before, they are computed on all the cores
+	bool digestHeaders = m_digests && m_digestPlacement == DigestHeaders;
+	if( digestHeaders ) hashFiles();
+	
+	for(int i = 0;i < m_files.count();i++)
+	{
+		QFileInfo fi( fromUtf8( m_files.value( i ) ) );
+		if( fi.isFile() && fi.isReadable() )
 		{
-			QFileInfo fi( file );
-			QString ext = fi.suffix();
+			QByteArray header = cachedFileHeader( m_files.name( i ), fi );
+			if( digestHeaders ) header = withDigestHeaders( header, cachedFile( m_files.name( i ), fi ).digestHeaders );
+			
+			// the digests sent in fields are computed while the file is sent
+			PartDigest * digest = m_digests && !digestHeaders ? new PartDigest( m_digests ) : 0;
+			
+			// the file may have been removed since it was stat'ed, the digest is destroyed with the body
+			body->appendData( header );
+			if( !body->appendFile( fi.filePath(), digest ) )
+			{
+				delete body;
+				return 0;
+			}
+			body->appendData( "\r\n" );
 			
-			QByteArray mime = "text/plain";
-			if( mimeTypes.contains( ext ) )
+			if( partSizes ) partSizes->append( qMakePair( fromUtf8( m_files.name( i ) ), header.size() + fi.size() + 2 ) );
+			
+			if( digest )
 			{
-				mime = mimeTypes[ext];
+				for(int algorithm = PartDigest::Crc32c;algorithm <= PartDigest::Sha256;algorithm <<= 1)
+				{
+					if( !( m_digests & algorithm ) ) continue;
+					
+					QByteArray name = digestFieldName( m_files.name( i ), PartDigest::Algorithm( algorithm ) );
+					QByteArray prefix = fieldPart( boundary, name, QByteArray() );
+					prefix.chop( 2 );
+					body->appendDigest( PartDigest::Algorithm( algorithm ), prefix, "\r\n" );
+					
+					if( partSizes ) partSizes->append( qMakePair( fromUtf8( name ), qint64( prefix.size() + PartDigest::resultSize( PartDigest::Algorithm( algorithm ) ) * 2 + 2 ) ) );
+				}
 			}
+		}
+	}
+	
+	// the data is shared with the form, not copied
+	foreach( const Data & part, m_data )
+	{
+		QByteArray header = partHeader( boundary, part.name, part.filename, part.mime );
+		
+		// the data is in memory, its digests are computed right away
+		QList< QPair< QByteArray, QByteArray > > digestFields;
+		if( m_digests )
+		{
+			PartDigest digest( m_digests );
+			digest.addData( part.data.constData(), part.data.size() );
 			
-			QByteArray aadata = "--" + boundary;
-			aadata += "\r\nContent-Disposition: form-data; name=\"" + i.key().toAscii() + "\"; filename=\"" + fi.fileName().toAscii() + "\";\r\n";
-			aadata += "Content-Type: " + mime + "\r\n\r\n" + file.readAll() + "\r\n";
-			file.close();
+			if( digestHeaders )
+			{
+				header = withDigestHeaders( header, digestHeaderLines( digest ) );
+			}
+			else
+			{
+				for(int algorithm = PartDigest::Crc32c;algorithm <= PartDigest::Sha256;algorithm <<= 1)
+				{
+					if( !( m_digests & algorithm ) ) continue;
+					
+					QByteArray name = digestFieldName( part.name.toUtf8(), PartDigest::Algorithm( algorithm ) );
+					digestFields.append( qMakePair( name, fieldPart( boundary, name, digest.result( PartDigest::Algorithm( algorithm ) ).toHex() ) ) );
+				}
+			}
+		}
+		
+		body->appendData( header );
+		body->appendData( part.data );
+		body->appendData( "\r\n" );
+		
+		if( partSizes ) partSizes->append( qMakePair( part.name, qint64( header.size() + part.data.size() + 2 ) ) );
+		
+		for(int i = 0;i < digestFields.count();i++)
+		{
+			body->appendData( digestFields[i].second );
 			
-			temp_data += aadata;
+			if( partSizes ) partSizes->append( qMakePair( fromUtf8( digestFields[i].first ), qint64( digestFields[i].second.size() ) ) );
 		}
 	}
 	
-	if( m_files.count() || m_forcemultipart )
+	return body;
+}
+
+////////////////////////////////////////////////////////////
+/// create the device generating the body and set its content type, 0 if a file can't be read
+////////////////////////////////////////////////////////////
+QIODevice * SendForm::createBody( qint64 & length, QList< QPair< QString, qint64 > > * partSizes, MultipartBodyDevice * parts )
+{
+	if( isMultipart() )
 	{
-		QHashIterator< QString, QString > i( m_fields );
-		while( i.hasNext() )
+		// the segments that didn't change since the last post are reused as they are
+		QByteArray boundary = this->boundary();
+		
+		MultipartBodyDevice * body = parts ? parts : createParts( partSizes );
+		if( !body ) return 0;
+		
+		foreach( const Device & part, m_devices )
 		{
-			i.next();
+			QByteArray header = partHeader( boundary, part.name, part.filename, part.mime );
+			qint64 size = part.bodySize();
+			body->appendData( header );
+			body->appendDevice( part.device, size );
+			body->appendData( "\r\n" );
 			
-			QByteArray aadata = "--" + boundary;
-			aadata += "\r\nContent-Disposition: form-data; name=\"" + i.key().toAscii() + "\"\r\n\r\n";
-			aadata += i.value().toAscii() + "\r\n";
+			if( partSizes ) partSizes->append( qMakePair( part.name, size < 0 ? size : header.size() + size + 2 ) );
+		}
+		
+		for(int i = 0;i < m_fields.count();i++)
+		{
+			QByteArray field = cachedFieldPart( i );
+			body->appendData( field );
 			
-			temp_data += aadata;
+			if( partSizes ) partSizes->append( qMakePair( fromUtf8( m_fields.name( i ) ), qint64( field.size() ) ) );
 		}
 		
+		body->appendData( closingBoundary( boundary ) );
+		body->open( QIODevice::ReadOnly | QIODevice::Unbuffered );
+		
 		m_request.setRawHeader( "Content-Type", "multipart/form-data; boundary=" + boundary );
-		temp_data += "--" + boundary + "--\r\n";
+		
+		length = sizeKnown() ? body->size() : -1;
+		return body;
 	}
-	else
+	
+	QBuffer * body = new QBuffer;
+	body->setData( urlEncodedBody() );
+	body->open( QIODevice::ReadOnly );
+	
+	length = body->size();
+	return body;
+}
+
+bool SendForm::isMultipart() const
+{
+	return !m_files.isEmpty() || !m_devices.isEmpty() || !m_data.isEmpty() || m_forcemultipart;
+}
+
+////////////////////////////////////////////////////////////
+/// a body can be read entirely right away if no device has to wait for its data
+////////////////////////////////////////////////////////////
+bool SendForm::canSpool() const
+{
+	foreach( const Device & part, m_devices )
+	{
+		if( part.device->isSequential() ) return false;
+	}
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// the length of the body is unknown if a device has no size
+////////////////////////////////////////////////////////////
+bool SendForm::sizeKnown() const
+{
+	foreach( const Device & part, m_devices )
+	{
+		if( part.bodySize() < 0 ) return false;
+	}
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// boundary and headers preceding the content of a file
+////////////////////////////////////////////////////////////
+QByteArray SendForm::fileHeader( const QByteArray & boundary, const QString & name, const QFileInfo & fi ) const
+{
+	QByteArray mime = "text/plain";
+	const char * type = mimeType( fi.suffix() );
+	if( type )
 	{
-		QHashIterator< QString, QString > i( m_fields );
-		while( i.hasNext() )
+		mime = type;
+	}
+	
+	// the content is only read when the suffix doesn't tell its type or says it is text
+	if( m_contentSniffing && ( !type || qstrncmp( type, "text/", 5 ) == 0 ) )
+	{
+		// a text type given by the suffix is more precise than "text/plain", and it is only
+		// overridden by a content that can't be a text ("BM" or "MZ" also begin some texts)
+		bool binary;
+		QByteArray sniffed = ContentSniffer::mimeType( fi, &binary );
+		if( !sniffed.isNull() && ( !type || binary ) ) mime = sniffed;
+	}
+	
+	return partHeader( boundary, name, fi.fileName(), mime );
+}
+
+////////////////////////////////////////////////////////////
+/// boundary and headers preceding the content of a "file" field
+////////////////////////////////////////////////////////////
+QByteArray SendForm::partHeader( const QByteArray & boundary, const QString & name, const QString & filename, const QByteArray & mime ) const
+{
+	QByteArray aadata = "--" + boundary;
+	aadata += "\r\nContent-Disposition: form-data; name=\"" + name.toUtf8() + "\"; filename=\"" + filename.toUtf8() + "\";\r\n";
+	aadata += "Content-Type: " + mime + "\r\n\r\n";
+	
+	return aadata;
+}
+
+////////////////////////////////////////////////////////////
+/// boundary, headers and value of a field
+////////////////////////////////////////////////////////////
+QByteArray SendForm::fieldPart( const QByteArray & boundary, const QByteArray & name, const QByteArray & value ) const
+{
+	static const char disposition[] = "\r\nContent-Disposition: form-data; name=\"";
+	
+	QByteArray aadata;
+	aadata.reserve( 2 + boundary.size() + int( sizeof( disposition ) ) - 1 + name.size() + 5 + value.size() + 2 );
+	
+	aadata += "--";
+	aadata += boundary;
+	aadata += disposition;
+	aadata += name;
+	aadata += "\"\r\n\r\n";
+	aadata += value;
+	aadata += "\r\n";
+	
+	return aadata;
+}
+
+////////////////////////////////////////////////////////////
+/// number of bytes that will be read from the device, -1 if it's unknown
+////////////////////////////////////////////////////////////
+qint64 SendForm::Device::bodySize() const
+{
+	if( size >= 0 || device->isSequential() ) return size;
+	
+	return device->size() - device->pos();
+}
+
+QByteArray SendForm::closingBoundary( const QByteArray & boundary ) const
+{
+	return "--" + boundary + "--\r\n";
+}
+
+QByteArray SendForm::urlEncodedBody() const
+{
+	if( !m_urlEncodedCache.isNull() ) return m_urlEncodedCache;
+	
+	// the names and the values are already in UTF-8, so the body can be sized before it is encoded
+	int length = qMax( 0, m_fields.count() - 1 );
+	for(int i = 0;i < m_fields.count();i++)
+	{
+		QByteArray name = m_fields.name( i );
+		QByteArray value = m_fields.value( i );
+		length += FormUrlEncoder::encodedLength( name.constData(), name.size() ) + 1 + FormUrlEncoder::encodedLength( value.constData(), value.size() );
+	}
+	
+	// not null even when there is no field, so an empty form is cached too
+	QByteArray temp_data( "" );
+	temp_data.resize( length );
+	char * out = temp_data.data();
+	
+	for(int i = 0;i < m_fields.count();i++)
+	{
+		QByteArray name = m_fields.name( i );
+		QByteArray value = m_fields.value( i );
+		
+		if( i ) *out++ = '&';
+		out = FormUrlEncoder::encode( name.constData(), name.size(), out );
+		*out++ = '=';
+		out = FormUrlEncoder::encode( value.constData(), value.size(), out );
+	}
+	
+	m_urlEncodedCache = temp_data;
+	
+	return m_urlEncodedCache;
+}
+
+////////////////////////////////////////////////////////////
+/// the boundary is kept for the lifetime of the form so the encoded parts can be cached
+////////////////////////////////////////////////////////////
+QByteArray SendForm::boundary() const
+{
+	if( m_boundary.isEmpty() ) m_boundary = generateBoundary();
+	
+	return m_boundary;
+}
+
+////////////////////////////////////////////////////////////
+/// header of a file, encoded again only if the file has changed since the last time
+////////////////////////////////////////////////////////////
+QByteArray SendForm::cachedFileHeader( const QByteArray & name, const QFileInfo & fi ) const
+{
+	return cachedFile( name, fi ).header;
+}
+
+////////////////////////////////////////////////////////////
+/// segments of a file, forgotten if the file has changed since the last time
+////////////////////////////////////////////////////////////
+SendForm::FileCache & SendForm::cachedFile( const QByteArray & name, const QFileInfo & fi ) const
+{
+	// the name is a view on the entries, the key must own its data
+	FileCache & cache = m_fileCache[ QByteArray( name.constData(), name.size() ) + '\0' + fi.filePath().toUtf8() ];
+	
+	QDateTime modified = fi.lastModified();
+	if( cache.header.isEmpty() || cache.path != fi.filePath() || cache.size != fi.size() || cache.modified != modified )
+	{
+		cache.path = fi.filePath();
+		cache.size = fi.size();
+		cache.modified = modified;
+		cache.header = fileHeader( boundary(), fromUtf8( name ), fi );
+		cache.digests = 0;
+		cache.digestHeaders.clear();
+	}
+	
+	return cache;
+}
+
+////////////////////////////////////////////////////////////
+/// files hashed by the threads of the pool, each one taking the next file to hash
+////////////////////////////////////////////////////////////
+struct DigestJob
+{
+	QAtomicInt next;
+	int digests;
+	QStringList paths;
+	QVector< QByteArray > headers;
+	QSemaphore done;
+	
+	void run()
+	{
+		for(int i = next.fetchAndAddRelaxed( 1 );i < paths.count();i = next.fetchAndAddRelaxed( 1 ))
 		{
-			i.next();
-			
-			temp_data += "&" + i.key().toAscii() + "=" + i.value().toAscii();
+			PartDigest digest( digests );
+			if( digest.addFile( paths[i] ) ) headers[i] = digestHeaderLines( digest );
 		}
+	}
+};
+
+class DigestTask : public QRunnable
+{
+public:
+	DigestTask( DigestJob * job ) : m_job( job )
+	{
+	}
+	
+	void run()
+	{
+		m_job->run();
+		m_job->done.release();
+	}
+
+private:
+	DigestJob * m_job;
+};
+
+////////////////////////////////////////////////////////////
+/// compute the digests of the files that changed since the last time
+////////////////////////////////////////////////////////////
+void SendForm::hashFiles() const
+{
+	DigestJob job;
+	job.digests = m_digests;
+	
+	// the cache can grow, so the entries are looked up again at the end
+	QList< int > files;
+	for(int i = 0;i < m_files.count();i++)
+	{
+		QFileInfo fi( fromUtf8( m_files.value( i ) ) );
+		if( !fi.isFile() || !fi.isReadable() ) continue;
+		if( cachedFile( m_files.name( i ), fi ).digests == m_digests ) continue;
 		
-		temp_data.remove(0, 1);
+		job.paths.append( fi.filePath() );
+		files.append( i );
 	}
 	
-	m_request.setRawHeader( "Content-Length", QByteArray::number( temp_data.size() ) );
+	if( job.paths.isEmpty() ) return;
+	job.headers.resize( job.paths.count() );
+	
+	// only the threads free right now help, so waiting for them can't block the pool
+	// (when this is called from one of its threads by postAsync())
+	QThreadPool * pool = QThreadPool::globalInstance();
+	int helpers = 0;
+	while( helpers < job.paths.count() - 1 && helpers < QThread::idealThreadCount() - 1 && pool->tryStart( new DigestTask( &job ) ) )
+	{
+		helpers++;
+	}
+	
+	job.run();
+	job.done.acquire( helpers );
+	
+	for(int i = 0;i < files.count();i++)
+	{
+		// a file that couldn't be read is hashed again the next time
+		if( job.headers[i].isEmpty() ) continue;
+		
+		FileCache & cache = cachedFile( m_files.name( files[i] ), QFileInfo( job.paths[i] ) );
+		cache.digests = m_digests;
+		cache.digestHeaders = job.headers[i];
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// number of bytes the digests add to a part
+////////////////////////////////////////////////////////////
+qint64 SendForm::digestSize( const QByteArray & name ) const
+{
+	if( !m_digests ) return 0;
+	
+	// the digests of no data are as long as the others
+	PartDigest digest( m_digests );
+	if( m_digestPlacement == DigestHeaders ) return digestHeaderLines( digest ).size();
+	
+	qint64 size = 0;
+	for(int algorithm = PartDigest::Crc32c;algorithm <= PartDigest::Sha256;algorithm <<= 1)
+	{
+		if( !( m_digests & algorithm ) ) continue;
+		
+		size += fieldPart( boundary(), digestFieldName( name, PartDigest::Algorithm( algorithm ) ), digest.result( PartDigest::Algorithm( algorithm ) ).toHex() ).size();
+	}
+	
+	return size;
+}
+
+////////////////////////////////////////////////////////////
+/// name of the field containing a digest of a part ("name.sha256")
+////////////////////////////////////////////////////////////
+QByteArray SendForm::digestFieldName( const QByteArray & name, PartDigest::Algorithm algorithm )
+{
+	return QByteArray( name.constData(), name.size() ) + '.' + PartDigest::name( algorithm );
+}
+
+////////////////////////////////////////////////////////////
+/// insert the digest headers before the empty line ending the headers of a part
+////////////////////////////////////////////////////////////
+QByteArray SendForm::withDigestHeaders( const QByteArray & header, const QByteArray & digestHeaders )
+{
+	return header.left( header.size() - 2 ) + digestHeaders + "\r\n";
+}
+
+////////////////////////////////////////////////////////////
+/// field part, encoded again only if the field has changed since the last time
+////////////////////////////////////////////////////////////
+QByteArray SendForm::cachedFieldPart( int i )
+{
+	const QByteArray & cached = m_fields.encoded( i );
+	if( !cached.isNull() ) return cached;
+	
+	QByteArray part = fieldPart( boundary(), m_fields.name( i ), m_fields.value( i ) );
+	m_fields.setEncoded( i, part );
 	
-	return manager->post( m_request, temp_data );
+	return part;
+}
+
+////////////////////////////////////////////////////////////
+/// compress the body while it is sent
+////////////////////////////////////////////////////////////
+void SendForm::setBodyCompression( int level, Compression compression )
+{
+	m_compressionLevel = qBound( -1, level, 9 );
+	m_compression = compression;
+}
+
+////////////////////////////////////////////////////////////
+/// find the content type of the files from their content too
+////////////////////////////////////////////////////////////
+void SendForm::setContentSniffing( bool enabled )
+{
+	if( enabled == m_contentSniffing ) return;
+	
+	// the cached headers have the types found the other way
+	m_contentSniffing = enabled;
+	m_fileCache.clear();
+}
+
+////////////////////////////////////////////////////////////
+/// set the number of files whose sniffed type is kept
+////////////////////////////////////////////////////////////
+void SendForm::setContentSniffingCacheSize( int entries )
+{
+	ContentSniffer::setCacheSize( entries );
+}
+
+////////////////////////////////////////////////////////////
+/// send digests of the files and of the in-memory data
+////////////////////////////////////////////////////////////
+void SendForm::setPartDigests( int digests, DigestPlacement placement )
+{
+#if QT_VERSION < 0x050000
+	digests &= ~Sha256;
+#endif
+	
+	m_digests = digests & ( Crc32c | Md5 | Sha1 | Sha256 );
+	m_digestPlacement = placement;
+}
+
+////////////////////////////////////////////////////////////
+/// send the headers with "Expect: 100-continue" and hold the body back for a while
+////////////////////////////////////////////////////////////
+void SendForm::setExpectContinue( bool enabled, int timeout )
+{
+	m_expectContinue = enabled;
+	m_continueTimeout = qMax( 0, timeout );
+}
+
+////////////////////////////////////////////////////////////
+/// send the body only as fast as a scheduler allows
+////////////////////////////////////////////////////////////
+void SendForm::setUploadScheduler( UploadScheduler * scheduler, int weight )
+{
+	m_uploadScheduler = scheduler;
+	m_uploadWeight = qMax( 1, weight );
+}
+
+////////////////////////////////////////////////////////////
+/// allow the form to be sent over HTTP/2
+////////////////////////////////////////////////////////////
+void SendForm::setHttp2( bool allowed, bool priorKnowledge )
+{
+#if QT_VERSION >= 0x050F00
+	m_request.setAttribute( QNetworkRequest::Http2AllowedAttribute, allowed );
+#elif QT_VERSION >= 0x050800
+	m_request.setAttribute( QNetworkRequest::HTTP2AllowedAttribute, allowed );
+#else
+	Q_UNUSED( allowed );
+#endif
+	
+#if QT_VERSION >= 0x050B00
+	m_request.setAttribute( QNetworkRequest::Http2DirectAttribute, allowed && priorKnowledge );
+#else
+	Q_UNUSED( priorKnowledge );
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// set the number of bytes of body this form can keep in memory
+////////////////////////////////////////////////////////////
+void SendForm::setMemoryBudget( qint64 bytes )
+{
+	m_memoryBudget = bytes;
+}
+
+////////////////////////////////////////////////////////////
+/// set the number of bytes of body all the forms can keep in memory
+////////////////////////////////////////////////////////////
+void SendForm::setProcessMemoryBudget( qint64 bytes )
+{
+	BodySpool::setProcessBudget( bytes );
+}
+
+qint64 SendForm::processMemoryUsed()
+{
+	return BodySpool::memoryUsed();
+}
+
+qint64 SendForm::inMemoryBodyCount()
+{
+	return BodySpool::inMemoryCount();
+}
+
+qint64 SendForm::spilledBodyCount()
+{
+	return BodySpool::spilledCount();
+}
+
+qint64 SendForm::spilledBytes()
+{
+	return BodySpool::spilledBytes();
+}
+
+////////////////////////////////////////////////////////////
+/// measure the requests sent by post()
+////////////////////////////////////////////////////////////
+void SendForm::setStatsEnabled( bool enabled )
+{
+	m_statsEnabled = enabled;
+}
+
+////////////////////////////////////////////////////////////
+/// aggregate the statistics of the requests sent by post()
+////////////////////////////////////////////////////////////
+void SendForm::setStatsCollector( SendFormStatsCollector * collector )
+{
+	m_statsCollector = collector;
 }
 
 ////////////////////////////////////////////////////////////
@@ -209,212 +1123,308 @@ void SendForm::removeMultipart()
 	m_forcemultipart = false;
 }
 
+// boundary can be only between 1 and 70 characters (I chose 60 arbitrarily).
+static const int boundaryLength = 60;
+
+static QAtomicInt boundaryGeneratorCount;
+
+////////////////////////////////////////////////////////////
+/// xorshift64* generator used for the boundaries, there is one per thread
+////////////////////////////////////////////////////////////
+class BoundaryGenerator
+{
+public:
+	BoundaryGenerator()
+	{
+		// mix the time, the thread and a global counter so that two threads started
+		// at the same moment don't share a sequence (splitmix64 finalizer)
+		quint64 seed = quint64( QDateTime::currentDateTime().toMSecsSinceEpoch() );
+		seed ^= quint64( quintptr( QThread::currentThreadId() ) ) << 17;
+		seed += quint64( boundaryGeneratorCount.fetchAndAddRelaxed( 1 ) + 1 ) * Q_UINT64_C( 0x9E3779B97F4A7C15 );
+		seed = ( seed ^ ( seed >> 30 ) ) * Q_UINT64_C( 0xBF58476D1CE4E5B9 );
+		seed = ( seed ^ ( seed >> 27 ) ) * Q_UINT64_C( 0x94D049BB133111EB );
+		seed ^= seed >> 31;
+		
+		m_state = seed ? seed : Q_UINT64_C( 0x9E3779B97F4A7C15 );
+	}
+	
+	quint64 next()
+	{
+		m_state ^= m_state >> 12;
+		m_state ^= m_state << 25;
+		m_state ^= m_state >> 27;
+		return m_state * Q_UINT64_C( 0x2545F4914F6CDD1D );
+	}
+
+private:
+	quint64 m_state;
+};
+
+Q_GLOBAL_STATIC( QThreadStorage< BoundaryGenerator * >, boundaryGenerators )
+
 QByteArray SendForm::generateBoundary()
 {
-	QByteArray bchars = "0123456789AZERTYUIOPQSDFGHJKLMWXCVBNazertyuiopqsdfghjklmwxcvbn'()+_,-./:=?";
-	QByteArray boundary;
+	// 64 characters allowed in a boundary that don't need the parameter to be quoted,
+	// so each character uses 6 bits of a draw
+	static const char bchars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-_";
+	
+	QThreadStorage< BoundaryGenerator * > * generators = boundaryGenerators();
+	if( !generators->hasLocalData() )
+	{
+		generators->setLocalData( new BoundaryGenerator );
+	}
+	BoundaryGenerator * generator = generators->localData();
+	
+	QByteArray boundary( boundaryLength, '-' );
+	char * data = boundary.data();
 	
-	for(int i = 0;i < 60;i++) // boundary can be only between 1 and 70 characters (I chose 60 arbitrarily).
+	quint64 bits = 0;
+	for(int i = 0;i < boundaryLength;i++)
 	{
-		boundary += bchars[qrand()%bchars.length()];
+		if( i % 10 == 0 ) bits = generator->next();
+		
+		data[i] = bchars[bits & 63];
+		bits >>= 6;
 	}
 	
 	return boundary;
 }
 
-bool SendForm::m_initialized = false;
-QHash< QString, QByteArray > SendForm::mimeTypes;
-
-void SendForm::init()
-{
-	qsrand(time(0));
-	
-	mimeTypes["323"] = "text/h323";
-	mimeTypes["acx"] = "application/internet-property-stream";
-	mimeTypes["ai"] = "application/postscript";
-	mimeTypes["aif"] = "audio/x-aiff";
-	mimeTypes["aifc"] = "audio/x-aiff";
-	mimeTypes["aiff"] = "audio/x-aiff";
-	mimeTypes["asf"] = "video/x-ms-asf";
-	mimeTypes["asr"] = "video/x-ms-asf";
-	mimeTypes["asx"] = "video/x-ms-asf";
-	mimeTypes["au"] = "audio/basic";
-	mimeTypes["avi"] = "video/x-msvideo";
-	mimeTypes["axs"] = "application/olescript";
-	mimeTypes["bas"] = "text/plain";
-	mimeTypes["bcpio"] = "application/x-bcpio";
-	mimeTypes["bin"] = "application/octet-stream";
-	mimeTypes["bmp"] = "image/bmp";
-	mimeTypes["c"] = "text/plain";
-	mimeTypes["cat"] = "application/vnd.ms-pkiseccat";
-	mimeTypes["cdf"] = "application/x-cdf";
-	mimeTypes["cer"] = "application/x-x509-ca-cert";
-	mimeTypes["class"] = "application/octet-stream";
-	mimeTypes["clp"] = "application/x-msclip";
-	mimeTypes["cmx"] = "image/x-cmx";
-	mimeTypes["cod"] = "image/cis-cod";
-	mimeTypes["cpio"] = "application/x-cpio";
-	mimeTypes["crd"] = "application/x-mscardfile";
-	mimeTypes["crl"] = "application/pkix-crl";
-	mimeTypes["crt"] = "application/x-x509-ca-cert";
-	mimeTypes["csh"] = "application/x-csh";
-	mimeTypes["css"] = "text/css";
-	mimeTypes["dcr"] = "application/x-director";
-	mimeTypes["der"] = "application/x-x509-ca-cert";
-	mimeTypes["dir"] = "application/x-director";
-	mimeTypes["dll"] = "application/x-msdownload";
-	mimeTypes["dms"] = "application/octet-stream";
-	mimeTypes["doc"] = "application/msword";
-	mimeTypes["dot"] = "application/msword";
-	mimeTypes["dvi"] = "application/x-dvi";
-	mimeTypes["dxr"] = "application/x-director";
-	mimeTypes["eps"] = "application/postscript";
-	mimeTypes["etx"] = "text/x-setext";
-	mimeTypes["evy"] = "application/envoy";
-	mimeTypes["exe"] = "application/octet-stream";
-	mimeTypes["fif"] = "application/fractals";
-	mimeTypes["flr"] = "x-world/x-vrml";
-	mimeTypes["gif"] = "image/gif";
-	mimeTypes["gtar"] = "application/x-gtar";
-	mimeTypes["gz"] = "application/x-gzip";
-	mimeTypes["h"] = "text/plain";
-	mimeTypes["hdf"] = "application/x-hdf";
-	mimeTypes["hlp"] = "application/winhlp";
-	mimeTypes["hqx"] = "application/mac-binhex40";
-	mimeTypes["hta"] = "application/hta";
-	mimeTypes["htc"] = "text/x-component";
-	mimeTypes["htm"] = "text/html";
-	mimeTypes["html"] = "text/html";
-	mimeTypes["htt"] = "text/webviewhtml";
-	mimeTypes["ico"] = "image/x-icon";
-	mimeTypes["ief"] = "image/ief";
-	mimeTypes["iii"] = "application/x-iphone";
-	mimeTypes["ins"] = "application/x-internet-signup";
-	mimeTypes["isp"] = "application/x-internet-signup";
-	mimeTypes["jfif"] = "image/pipeg";
-	mimeTypes["jpe"] = "image/jpeg";
-	mimeTypes["jpeg"] = "image/jpeg";
-	mimeTypes["jpg"] = "image/jpeg";
-	mimeTypes["js"] = "application/x-javascript";
-	mimeTypes["latex"] = "application/x-latex";
-	mimeTypes["lha"] = "application/octet-stream";
-	mimeTypes["lsf"] = "video/x-la-asf";
-	mimeTypes["lsx"] = "video/x-la-asf";
-	mimeTypes["lzh"] = "application/octet-stream";
-	mimeTypes["m13"] = "application/x-msmediaview";
-	mimeTypes["m14"] = "application/x-msmediaview";
-	mimeTypes["m3u"] = "audio/x-mpegurl";
-	mimeTypes["man"] = "application/x-troff-man";
-	mimeTypes["mdb"] = "application/x-msaccess";
-	mimeTypes["me"] = "application/x-troff-me";
-	mimeTypes["mht"] = "message/rfc822";
-	mimeTypes["mhtml"] = "message/rfc822";
-	mimeTypes["mid"] = "audio/mid";
-	mimeTypes["mny"] = "application/x-msmoney";
-	mimeTypes["mov"] = "video/quicktime";
-	mimeTypes["movie"] = "video/x-sgi-movie";
-	mimeTypes["mp2"] = "video/mpeg";
-	mimeTypes["mp3"] = "audio/mpeg";
-	mimeTypes["mpa"] = "video/mpeg";
-	mimeTypes["mpe"] = "video/mpeg";
-	mimeTypes["mpeg"] = "video/mpeg";
-	mimeTypes["mpg"] = "video/mpeg";
-	mimeTypes["mpp"] = "application/vnd.ms-project";
-	mimeTypes["mpv2"] = "video/mpeg";
-	mimeTypes["ms"] = "application/x-troff-ms";
-	mimeTypes["mvb"] = "application/x-msmediaview";
-	mimeTypes["nws"] = "message/rfc822";
-	mimeTypes["oda"] = "application/oda";
-	mimeTypes["p10"] = "application/pkcs10";
-	mimeTypes["p12"] = "application/x-pkcs12";
-	mimeTypes["p7b"] = "application/x-pkcs7-certificates";
-	mimeTypes["p7c"] = "application/x-pkcs7-mime";
-	mimeTypes["p7m"] = "application/x-pkcs7-mime";
-	mimeTypes["p7r"] = "application/x-pkcs7-certreqresp";
-	mimeTypes["p7s"] = "application/x-pkcs7-signature";
-	mimeTypes["pbm"] = "image/x-portable-bitmap";
-	mimeTypes["pdf"] = "application/pdf";
-	mimeTypes["pfx"] = "application/x-pkcs12";
-	mimeTypes["pgm"] = "image/x-portable-graymap";
-	mimeTypes["pko"] = "application/ynd.ms-pkipko";
-	mimeTypes["pma"] = "application/x-perfmon";
-	mimeTypes["pmc"] = "application/x-perfmon";
-	mimeTypes["pml"] = "application/x-perfmon";
-	mimeTypes["pmr"] = "application/x-perfmon";
-	mimeTypes["pmw"] = "application/x-perfmon";
-	mimeTypes["png"] = "image/png";
-	mimeTypes["pnm"] = "image/x-portable-anymap";
-	mimeTypes["pot"] = "application/vnd.ms-powerpoint";
-	mimeTypes["ppm"] = "image/x-portable-pixmap";
-	mimeTypes["pps"] = "application/vnd.ms-powerpoint";
-	mimeTypes["ppt"] = "application/vnd.ms-powerpoint";
-	mimeTypes["prf"] = "application/pics-rules";
-	mimeTypes["ps"] = "application/postscript";
-	mimeTypes["pub"] = "application/x-mspublisher";
-	mimeTypes["qt"] = "video/quicktime";
-	mimeTypes["ra"] = "audio/x-pn-realaudio";
-	mimeTypes["ram"] = "audio/x-pn-realaudio";
-	mimeTypes["ras"] = "image/x-cmu-raster";
-	mimeTypes["rgb"] = "image/x-rgb";
-	mimeTypes["rmi"] = "audio/mid";
-	mimeTypes["roff"] = "application/x-troff";
-	mimeTypes["rtf"] = "application/rtf";
-	mimeTypes["rtx"] = "text/richtext";
-	mimeTypes["scd"] = "application/x-msschedule";
-	mimeTypes["sct"] = "text/scriptlet";
-	mimeTypes["setpay"] = "application/set-payment-initiation";
-	mimeTypes["setreg"] = "application/set-registration-initiation";
-	mimeTypes["sh"] = "application/x-sh";
-	mimeTypes["shar"] = "application/x-shar";
-	mimeTypes["sit"] = "application/x-stuffit";
-	mimeTypes["snd"] = "audio/basic";
-	mimeTypes["spc"] = "application/x-pkcs7-certificates";
-	mimeTypes["spl"] = "application/futuresplash";
-	mimeTypes["src"] = "application/x-wais-source";
-	mimeTypes["sst"] = "application/vnd.ms-pkicertstore";
-	mimeTypes["stl"] = "application/vnd.ms-pkistl";
-	mimeTypes["stm"] = "text/html";
-	mimeTypes["svg"] = "image/svg+xml";
-	mimeTypes["sv4cpio"] = "application/x-sv4cpio";
-	mimeTypes["sv4crc"] = "application/x-sv4crc";
-	mimeTypes["swf"] = "application/x-shockwave-flash";
-	mimeTypes["t"] = "application/x-troff";
-	mimeTypes["tar"] = "application/x-tar";
-	mimeTypes["tcl"] = "application/x-tcl";
-	mimeTypes["tex"] = "application/x-tex";
-	mimeTypes["texi"] = "application/x-texinfo";
-	mimeTypes["texinfo"] = "application/x-texinfo";
-	mimeTypes["tgz"] = "application/x-compressed";
-	mimeTypes["tif"] = "image/tiff";
-	mimeTypes["tiff"] = "image/tiff";
-	mimeTypes["tr"] = "application/x-troff";
-	mimeTypes["trm"] = "application/x-msterminal";
-	mimeTypes["tsv"] = "text/tab-separated-values";
-	mimeTypes["txt"] = "text/plain";
-	mimeTypes["uls"] = "text/iuls";
-	mimeTypes["ustar"] = "application/x-ustar";
-	mimeTypes["vcf"] = "text/x-vcard";
-	mimeTypes["vrml"] = "x-world/x-vrml";
-	mimeTypes["wav"] = "audio/x-wav";
-	mimeTypes["wcm"] = "application/vnd.ms-works";
-	mimeTypes["wdb"] = "application/vnd.ms-works";
-	mimeTypes["wks"] = "application/vnd.ms-works";
-	mimeTypes["wmf"] = "application/x-msmetafile";
-	mimeTypes["wps"] = "application/vnd.ms-works";
-	mimeTypes["wri"] = "application/x-mswrite";
-	mimeTypes["wrl"] = "x-world/x-vrml";
-	mimeTypes["wrz"] = "x-world/x-vrml";
-	mimeTypes["xaf"] = "x-world/x-vrml";
-	mimeTypes["xbm"] = "image/x-xbitmap";
-	mimeTypes["xla"] = "application/vnd.ms-excel";
-	mimeTypes["xlc"] = "application/vnd.ms-excel";
-	mimeTypes["xlm"] = "application/vnd.ms-excel";
-	mimeTypes["xls"] = "application/vnd.ms-excel";
-	mimeTypes["xlt"] = "application/vnd.ms-excel";
-	mimeTypes["xlw"] = "application/vnd.ms-excel";
-	mimeTypes["xof"] = "x-world/x-vrml";
-	mimeTypes["xpm"] = "image/x-xpixmap";
-	mimeTypes["xwd"] = "image/x-xwindowdump";
-	mimeTypes["z"] = "application/x-compress";
-	mimeTypes["zip"] = "application/zip";
+////////////////////////////////////////////////////////////
+/// known suffixes, sorted so they can be looked up with a binary search
+////////////////////////////////////////////////////////////
+struct MimeType
+{
+	const char * suffix;
+	const char * type;
+};
+
+static const MimeType mimeTypes[] =
+{
+	{ "323", "text/h323" },
+	{ "acx", "application/internet-property-stream" },
+	{ "ai", "application/postscript" },
+	{ "aif", "audio/x-aiff" },
+	{ "aifc", "audio/x-aiff" },
+	{ "aiff", "audio/x-aiff" },
+	{ "asf", "video/x-ms-asf" },
+	{ "asr", "video/x-ms-asf" },
+	{ "asx", "video/x-ms-asf" },
+	{ "au", "audio/basic" },
+	{ "avi", "video/x-msvideo" },
+	{ "axs", "application/olescript" },
+	{ "bas", "text/plain" },
+	{ "bcpio", "application/x-bcpio" },
+	{ "bin", "application/octet-stream" },
+	{ "bmp", "image/bmp" },
+	{ "c", "text/plain" },
+	{ "cat", "application/vnd.ms-pkiseccat" },
+	{ "cdf", "application/x-cdf" },
+	{ "cer", "application/x-x509-ca-cert" },
+	{ "class", "application/octet-stream" },
+	{ "clp", "application/x-msclip" },
+	{ "cmx", "image/x-cmx" },
+	{ "cod", "image/cis-cod" },
+	{ "cpio", "application/x-cpio" },
+	{ "crd", "application/x-mscardfile" },
+	{ "crl", "application/pkix-crl" },
+	{ "crt", "application/x-x509-ca-cert" },
+	{ "csh", "application/x-csh" },
+	{ "css", "text/css" },
+	{ "dcr", "application/x-director" },
+	{ "der", "application/x-x509-ca-cert" },
+	{ "dir", "application/x-director" },
+	{ "dll", "application/x-msdownload" },
+	{ "dms", "application/octet-stream" },
+	{ "doc", "application/msword" },
+	{ "dot", "application/msword" },
+	{ "dvi", "application/x-dvi" },
+	{ "dxr", "application/x-director" },
+	{ "eps", "application/postscript" },
+	{ "etx", "text/x-setext" },
+	{ "evy", "application/envoy" },
+	{ "exe", "application/octet-stream" },
+	{ "fif", "application/fractals" },
+	{ "flr", "x-world/x-vrml" },
+	{ "gif", "image/gif" },
+	{ "gtar", "application/x-gtar" },
+	{ "gz", "application/x-gzip" },
+	{ "h", "text/plain" },
+	{ "hdf", "application/x-hdf" },
+	{ "hlp", "application/winhlp" },
+	{ "hqx", "application/mac-binhex40" },
+	{ "hta", "application/hta" },
+	{ "htc", "text/x-component" },
+	{ "htm", "text/html" },
+	{ "html", "text/html" },
+	{ "htt", "text/webviewhtml" },
+	{ "ico", "image/x-icon" },
+	{ "ief", "image/ief" },
+	{ "iii", "application/x-iphone" },
+	{ "ins", "application/x-internet-signup" },
+	{ "isp", "application/x-internet-signup" },
+	{ "jfif", "image/pipeg" },
+	{ "jpe", "image/jpeg" },
+	{ "jpeg", "image/jpeg" },
+	{ "jpg", "image/jpeg" },
+	{ "js", "application/x-javascript" },
+	{ "latex", "application/x-latex" },
+	{ "lha", "application/octet-stream" },
+	{ "lsf", "video/x-la-asf" },
+	{ "lsx", "video/x-la-asf" },
+	{ "lzh", "application/octet-stream" },
+	{ "m13", "application/x-msmediaview" },
+	{ "m14", "application/x-msmediaview" },
+	{ "m3u", "audio/x-mpegurl" },
+	{ "man", "application/x-troff-man" },
+	{ "mdb", "application/x-msaccess" },
+	{ "me", "application/x-troff-me" },
+	{ "mht", "message/rfc822" },
+	{ "mhtml", "message/rfc822" },
+	{ "mid", "audio/mid" },
+	{ "mny", "application/x-msmoney" },
+	{ "mov", "video/quicktime" },
+	{ "movie", "video/x-sgi-movie" },
+	{ "mp2", "video/mpeg" },
+	{ "mp3", "audio/mpeg" },
+	{ "mpa", "video/mpeg" },
+	{ "mpe", "video/mpeg" },
+	{ "mpeg", "video/mpeg" },
+	{ "mpg", "video/mpeg" },
+	{ "mpp", "application/vnd.ms-project" },
+	{ "mpv2", "video/mpeg" },
+	{ "ms", "application/x-troff-ms" },
+	{ "mvb", "application/x-msmediaview" },
+	{ "nws", "message/rfc822" },
+	{ "oda", "application/oda" },
+	{ "p10", "application/pkcs10" },
+	{ "p12", "application/x-pkcs12" },
+	{ "p7b", "application/x-pkcs7-certificates" },
+	{ "p7c", "application/x-pkcs7-mime" },
+	{ "p7m", "application/x-pkcs7-mime" },
+	{ "p7r", "application/x-pkcs7-certreqresp" },
+	{ "p7s", "application/x-pkcs7-signature" },
+	{ "pbm", "image/x-portable-bitmap" },
+	{ "pdf", "application/pdf" },
+	{ "pfx", "application/x-pkcs12" },
+	{ "pgm", "image/x-portable-graymap" },
+	{ "pko", "application/ynd.ms-pkipko" },
+	{ "pma", "application/x-perfmon" },
+	{ "pmc", "application/x-perfmon" },
+	{ "pml", "application/x-perfmon" },
+	{ "pmr", "application/x-perfmon" },
+	{ "pmw", "application/x-perfmon" },
+	{ "png", "image/png" },
+	{ "pnm", "image/x-portable-anymap" },
+	{ "pot", "application/vnd.ms-powerpoint" },
+	{ "ppm", "image/x-portable-pixmap" },
+	{ "pps", "application/vnd.ms-powerpoint" },
+	{ "ppt", "application/vnd.ms-powerpoint" },
+	{ "prf", "application/pics-rules" },
+	{ "ps", "application/postscript" },
+	{ "pub", "application/x-mspublisher" },
+	{ "qt", "video/quicktime" },
+	{ "ra", "audio/x-pn-realaudio" },
+	{ "ram", "audio/x-pn-realaudio" },
+	{ "ras", "image/x-cmu-raster" },
+	{ "rgb", "image/x-rgb" },
+	{ "rmi", "audio/mid" },
+	{ "roff", "application/x-troff" },
+	{ "rtf", "application/rtf" },
+	{ "rtx", "text/richtext" },
+	{ "scd", "application/x-msschedule" },
+	{ "sct", "text/scriptlet" },
+	{ "setpay", "application/set-payment-initiation" },
+	{ "setreg", "application/set-registration-initiation" },
+	{ "sh", "application/x-sh" },
+	{ "shar", "application/x-shar" },
+	{ "sit", "application/x-stuffit" },
+	{ "snd", "audio/basic" },
+	{ "spc", "application/x-pkcs7-certificates" },
+	{ "spl", "application/futuresplash" },
+	{ "src", "application/x-wais-source" },
+	{ "sst", "application/vnd.ms-pkicertstore" },
+	{ "stl", "application/vnd.ms-pkistl" },
+	{ "stm", "text/html" },
+	{ "sv4cpio", "application/x-sv4cpio" },
+	{ "sv4crc", "application/x-sv4crc" },
+	{ "svg", "image/svg+xml" },
+	{ "swf", "application/x-shockwave-flash" },
+	{ "t", "application/x-troff" },
+	{ "tar", "application/x-tar" },
+	{ "tcl", "application/x-tcl" },
+	{ "tex", "application/x-tex" },
+	{ "texi", "application/x-texinfo" },
+	{ "texinfo", "application/x-texinfo" },
+	{ "tgz", "application/x-compressed" },
+	{ "tif", "image/tiff" },
+	{ "tiff", "image/tiff" },
+	{ "tr", "application/x-troff" },
+	{ "trm", "application/x-msterminal" },
+	{ "tsv", "text/tab-separated-values" },
+	{ "txt", "text/plain" },
+	{ "uls", "text/iuls" },
+	{ "ustar", "application/x-ustar" },
+	{ "vcf", "text/x-vcard" },
+	{ "vrml", "x-world/x-vrml" },
+	{ "wav", "audio/x-wav" },
+	{ "wcm", "application/vnd.ms-works" },
+	{ "wdb", "application/vnd.ms-works" },
+	{ "wks", "application/vnd.ms-works" },
+	{ "wmf", "application/x-msmetafile" },
+	{ "wps", "application/vnd.ms-works" },
+	{ "wri", "application/x-mswrite" },
+	{ "wrl", "x-world/x-vrml" },
+	{ "wrz", "x-world/x-vrml" },
+	{ "xaf", "x-world/x-vrml" },
+	{ "xbm", "image/x-xbitmap" },
+	{ "xla", "application/vnd.ms-excel" },
+	{ "xlc", "application/vnd.ms-excel" },
+	{ "xlm", "application/vnd.ms-excel" },
+	{ "xls", "application/vnd.ms-excel" },
+	{ "xlt", "application/vnd.ms-excel" },
+	{ "xlw", "application/vnd.ms-excel" },
+	{ "xof", "x-world/x-vrml" },
+	{ "xpm", "image/x-xpixmap" },
+	{ "xwd", "image/x-xwindowdump" },
+	{ "z", "application/x-compress" },
+	{ "zip", "application/zip" },
+};
+
+static const int mimeTypesCount = sizeof( mimeTypes ) / sizeof( mimeTypes[0] );
+
+////////////////////////////////////////////////////////////
+/// find the mime type of a suffix (case insensitive)
+////////////////////////////////////////////////////////////
+const char * SendForm::mimeType( const QString & suffix )
+{
+	// no known suffix is longer than that
+	char key[8];
+	
+	int length = suffix.length();
+	if( length == 0 || length >= int( sizeof( key ) ) ) return 0;
+	
+	for(int i = 0;i < length;i++)
+	{
+		ushort c = suffix.at( i ).unicode();
+		if( c >= 'A' && c <= 'Z' ) c += 'a' - 'A';
+		if( c > 127 ) return 0;
+		
+		key[i] = char( c );
+	}
+	key[length] = 0;
+	
+	int first = 0;
+	int last = mimeTypesCount - 1;
+	while( first <= last )
+	{
+		int middle = ( first + last ) / 2;
+		int cmp = qstrcmp( key, mimeTypes[middle].suffix );
+		
+		if( cmp == 0 ) return mimeTypes[middle].type;
+		if( cmp < 0 ) last = middle - 1;
+		else first = middle + 1;
+	}
+	
+	return 0;
 }
@@ -18,21 +18,68 @@
 #ifndef SEND_FORM_WITH_QT
 #define SEND_FORM_WITH_QT
 
+#include "FormEntries.h"
+#include "PartDigest.h"
+
 #include <QByteArray>
+#include <QDateTime>
+#include <QFileInfo>
 #include <QHash>
+#include <QIODevice>
+#include <QList>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QPair>
 #include <QString>
 #include <QStringList>
+#include <QThreadPool>
 #include <QUrl>
 
+class MultipartBodyDevice;
+class SendFormAsyncPost;
+class SendFormStats;
+class SendFormStatsCollector;
+class UploadScheduler;
+
 ////////////////////////////////////////////////////////////
 /// SendForm can send files and fields (html's &lt;input&gt;) to a website.
 ////////////////////////////////////////////////////////////
 class SendForm
 {
 public:
+	////////////////////////////////////////////////////////////
+	/// format of a compressed body
+	///
+	////////////////////////////////////////////////////////////
+	enum Compression
+	{
+		Gzip,	///< "Content-Encoding: gzip"
+		Deflate	///< "Content-Encoding: deflate" (zlib format)
+	};
+	
+	////////////////////////////////////////////////////////////
+	/// digests of the parts
+	///
+	////////////////////////////////////////////////////////////
+	enum Digest
+	{
+		Crc32c = PartDigest::Crc32c,	///< CRC-32C, computed by the processor when it has SSE 4.2
+		Md5 = PartDigest::Md5,			///< MD5
+		Sha1 = PartDigest::Sha1,		///< SHA-1
+		Sha256 = PartDigest::Sha256		///< SHA-256 (needs Qt 5)
+	};
+	
+	////////////////////////////////////////////////////////////
+	/// where the digests of the parts are sent
+	///
+	////////////////////////////////////////////////////////////
+	enum DigestPlacement
+	{
+		DigestHeaders,	///< "Content-MD5" and "Digest" headers of each part, the files are hashed (in parallel) before the body is sent
+		DigestFields	///< a field "<name>.<algorithm>" after each part with the digest in hexadecimal, the files are hashed while they are sent
+	};
+	
 	////////////////////////////////////////////////////////////
 	/// Constructor
 	///
@@ -41,15 +88,84 @@ public:
 	////////////////////////////////////////////////////////////
 	SendForm( const QUrl & destination );
 	
+	////////////////////////////////////////////////////////////
+	/// open a connection to the destination and create a form to copy for each post to it
+	///
+	/// \param manager : the QNetworkAccessManager that will send the forms, its connection is reused by the first post
+	/// \param destination : url that will received the forms
+	/// \param http2 : true to send the forms over HTTP/2 (see setHttp2), the connection then negotiates it with ALPN
+	///
+	/// \return an empty form, the copies share its request and headers until they change them
+	///
+	/// \remarks the headers set on the returned form are kept by its copies
+	/// \remarks the connection is only opened with Qt 5.2 and later, and over https if the SSL support is built in
+	/// \remarks QNetworkAccessManager keeps its HTTP/2 connections apart from the HTTP/1.1 ones, so with http2 the connection
+	/// is only opened over https with Qt 5.15 and later; an HTTP/2 connection without TLS (setHttp2( true, true )) can't be opened
+	/// in advance, the first post opens it
+	///
+	////////////////////////////////////////////////////////////
+	static SendForm prepare( QNetworkAccessManager * manager, const QUrl & destination, bool http2 = false );
+	
+	////////////////////////////////////////////////////////////
+	/// get the url that will receive the form
+	///
+	////////////////////////////////////////////////////////////
+	const QUrl & destination() const;
+	
 	////////////////////////////////////////////////////////////
 	/// add a field to the form
 	///
 	/// \param name : the name of the field
 	/// \param value : the value of the field
 	///
+	/// \remarks the fields are sent in the order they were added, a name can be added several times (i.e. "tags[]")
+	/// \remarks the name and the value are sent in UTF-8 (and percent-encoded in a "x-www-form-urlencoded" form)
+	///
+	/// \see setField
+	///
 	////////////////////////////////////////////////////////////
 	void addField( const QString & name, const QString & value );
 	
+	////////////////////////////////////////////////////////////
+	/// add a field whose name and value are already encoded in UTF-8
+	///
+	/// \param name : the name of the field
+	/// \param value : the value of the field
+	///
+	/// \remarks the bytes are copied as they are, without going through a QString
+	///
+	////////////////////////////////////////////////////////////
+	void addField( const QByteArray & name, const QByteArray & value );
+	
+	////////////////////////////////////////////////////////////
+	/// add a field whose name and value are UTF-8 strings (i.e. literals)
+	///
+	/// \param name : the name of the field
+	/// \param value : the value of the field
+	///
+	////////////////////////////////////////////////////////////
+	void addField( const char * name, const char * value );
+	
+	////////////////////////////////////////////////////////////
+	/// set the value of a field, replacing all its previous values
+	///
+	/// \param name : the name of the field
+	/// \param value : the value of the field
+	///
+	/// \remarks the field keeps the position of its first value, it is added at the end if it doesn't exist yet
+	///
+	////////////////////////////////////////////////////////////
+	void setField( const QString & name, const QString & value );
+	
+	////////////////////////////////////////////////////////////
+	/// reserve room for the fields, so adding them doesn't allocate memory
+	///
+	/// \param count : the number of fields
+	/// \param bytes : the total size of their names and values in UTF-8
+	///
+	////////////////////////////////////////////////////////////
+	void reserveFields( int count, int bytes );
+	
 	////////////////////////////////////////////////////////////
 	/// add several fields at once
 	///
@@ -77,6 +193,8 @@ public:
 	/// \param name : the name of the field
 	/// \param file : the file path
 	///
+	/// \remarks the files are sent in the order they were added, a name can be added several times
+	///
 	////////////////////////////////////////////////////////////
 	void addFile( const QString & name, const QString & file );
 	
@@ -94,7 +212,47 @@ public:
 	void addFiles( const QStringList & names, const QStringList & files );
 	
 	////////////////////////////////////////////////////////////
-	/// remove all the files of the form
+	/// add a field "file" whose content is read from a device (a pipe, a socket, a generator, ...)
+	///
+	/// \param name : the name of the field
+	/// \param device : an opened device, it must stay valid until the reply has finished
+	/// \param filename : the file name sent with the content
+	/// \param mime : the content type of the content
+	/// \param size : the number of bytes to send, or -1 to send everything until the end of the device
+	///
+	/// \remarks the device is read from its current position, a sequential device can only be sent once
+	/// \remarks when the size of a sequential device isn't given, the end is reached when read() returns -1 or readChannelFinished() has been emitted,
+	/// and QNetworkAccessManager reads the whole body before sending it because it needs its length
+	///
+	////////////////////////////////////////////////////////////
+	void addDevice( const QString & name, QIODevice * device, const QString & filename, const QByteArray & mime = "application/octet-stream", qint64 size = -1 );
+	
+	////////////////////////////////////////////////////////////
+	/// add a field "file" whose content is in memory
+	///
+	/// \param name : the name of the field
+	/// \param data : the content of the file
+	/// \param filename : the file name sent with the content
+	/// \param mime : the content type of the content
+	///
+	/// \remarks the data is implicitly shared with the form and the body, it is never copied until the network layer reads it
+	/// (as long as the caller doesn't modify its own copy before the reply has finished)
+	///
+	////////////////////////////////////////////////////////////
+	void addData( const QString & name, const QByteArray & data, const QString & filename, const QByteArray & mime = "application/octet-stream" );
+	
+#ifdef Q_COMPILER_RVALUE_REFS
+	////////////////////////////////////////////////////////////
+	/// add a field "file" whose content is in memory, taking the ownership of the data
+	///
+	/// \see addData
+	///
+	////////////////////////////////////////////////////////////
+	void addData( const QString & name, QByteArray && data, const QString & filename, const QByteArray & mime = "application/octet-stream" );
+#endif
+	
+	////////////////////////////////////////////////////////////
+	/// remove all the files (devices and data) of the form
 	///
 	////////////////////////////////////////////////////////////
 	void clearFiles();
@@ -149,28 +307,293 @@ public:
 	////////////////////////////////////////////////////////////
 	void removeMultipart();
 	
+	////////////////////////////////////////////////////////////
+	/// compress the body while it is sent
+	///
+	/// \param level : the zlib compression level (1 to 9, -1 for the default level), 0 to send the body uncompressed
+	/// \param compression : the format of the compressed body
+	///
+	/// \remarks the compressed size is only known at the end, so the body is compressed before being sent (see setMemoryBudget)
+	/// \remarks the server must accept compressed requests
+	///
+	////////////////////////////////////////////////////////////
+	void setBodyCompression( int level, Compression compression = Gzip );
+	
+	////////////////////////////////////////////////////////////
+	/// find the content type of the files from their first bytes when their suffix isn't enough
+	///
+	/// \param enabled : true to read the beginning of the files without a known suffix, or whose suffix says they are text
+	///
+	/// \remarks the signatures of the common binary formats are recognized, a file without signature is
+	/// "text/plain" unless it has control characters ("application/octet-stream")
+	/// \remarks a text suffix is only overridden by a content that can't be a text: a long enough signature, or control characters
+	/// \remarks only the first 512 bytes are read, and the result is kept for the process while the file isn't modified
+	/// \remarks the files are then read by plannedSize() as well
+	///
+	/// \see setContentSniffingCacheSize
+	///
+	////////////////////////////////////////////////////////////
+	void setContentSniffing( bool enabled );
+	
+	////////////////////////////////////////////////////////////
+	/// set the number of files whose sniffed content type is kept by the process
+	///
+	/// \param entries : the number of files (1024 by default), the least recently used ones are forgotten first
+	///
+	////////////////////////////////////////////////////////////
+	static void setContentSniffingCacheSize( int entries );
+	
+	////////////////////////////////////////////////////////////
+	/// send digests of the files and of the in-memory data
+	///
+	/// \param digests : the digests to send (combination of Digest), 0 to send none
+	/// \param placement : where the digests are sent
+	///
+	/// \remarks the digests sent in the headers are kept for the next posts while the files don't change
+	/// \remarks the digests sent in fields are computed in the same pass that sends the files,
+	/// they are only read again if the body is read out of order
+	/// \remarks the devices have no digest
+	///
+	////////////////////////////////////////////////////////////
+	void setPartDigests( int digests, DigestPlacement placement = DigestFields );
+	
+	////////////////////////////////////////////////////////////
+	/// send the headers with "Expect: 100-continue" and hold the body back for a while
+	///
+	/// \param enabled : true to wait before sending the body
+	/// \param timeout : the time to wait before sending the body anyway, in milliseconds
+	///
+	/// \remarks QNetworkAccessManager hides the "100 Continue" response, so the body is always sent after the timeout,
+	/// unless the server has rejected the request and closed the connection before
+	/// \remarks the body becomes sequential, so it can't be sent again on a redirection or an authentication
+	/// \remarks ignored when the length of the body isn't known, QNetworkAccessManager reads it before sending the headers
+	///
+	////////////////////////////////////////////////////////////
+	void setExpectContinue( bool enabled, int timeout = 1000 );
+	
+	////////////////////////////////////////////////////////////
+	/// send the body only as fast as a scheduler allows
+	///
+	/// \param scheduler : the scheduler of the uploads, 0 for no limit (the default)
+	/// \param weight : the share of the bandwidth this form gets compared to the others waiting (at least 1)
+	///
+	/// \remarks the scheduler must live in the thread calling post() and outlive the replies
+	/// \remarks the body becomes sequential, so it can't be sent again on a redirection or an authentication
+	/// \remarks ignored when the length of the body isn't known, QNetworkAccessManager reads it before sending it
+	///
+	/// \see UploadScheduler
+	///
+	////////////////////////////////////////////////////////////
+	void setUploadScheduler( UploadScheduler * scheduler, int weight = 1 );
+	
+	////////////////////////////////////////////////////////////
+	/// allow the form to be sent over HTTP/2, so the forms to the same host share one connection
+	///
+	/// \param allowed : true to use HTTP/2 when the server accepts it (negotiated with ALPN over https)
+	/// \param priorKnowledge : true to talk HTTP/2 right away, the only way for http urls (h2c)
+	///
+	/// \remarks needs Qt 5.8, and Qt 5.11 for the prior knowledge, ignored before
+	/// \remarks the number of forms multiplexed on the connection is the one SendFormBatch lets in flight
+	///
+	/// \see SendFormBatch::setMaxConcurrentPerHost
+	///
+	////////////////////////////////////////////////////////////
+	void setHttp2( bool allowed, bool priorKnowledge = false );
+	
+	////////////////////////////////////////////////////////////
+	/// set the number of bytes of body this form can keep in memory
+	///
+	/// \param bytes : the budget (4 MiB by default), 0 to always use a temporary file, negative for no limit besides the process one
+	///
+	/// \remarks only the bodies whose length isn't known in advance (compressed ones) are read before being sent,
+	/// the others are read from their sources while they are sent
+	/// \remarks a body with a sequential device can't be read without waiting for the event loop, so it is still read in memory by QNetworkAccessManager
+	/// \remarks a body that doesn't fit in the budget of the form or in the one of the process is spilled to a temporary file
+	///
+	/// \see setProcessMemoryBudget
+	///
+	////////////////////////////////////////////////////////////
+	void setMemoryBudget( qint64 bytes );
+	
+	////////////////////////////////////////////////////////////
+	/// set the number of bytes of body all the forms of the process can keep in memory
+	///
+	/// \param bytes : the budget (64 MiB by default), negative for no limit
+	///
+	/// \remarks the memory is given back when the reply is destroyed
+	///
+	////////////////////////////////////////////////////////////
+	static void setProcessMemoryBudget( qint64 bytes );
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body kept in memory by all the forms of the process
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 processMemoryUsed();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bodies that were read before being sent and fitted in memory
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 inMemoryBodyCount();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bodies that were read before being sent and spilled to a temporary file
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 spilledBodyCount();
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body written to temporary files
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 spilledBytes();
+	
+	////////////////////////////////////////////////////////////
+	/// measure the requests sent by post()
+	///
+	/// \param enabled : true to attach a SendFormStats to each reply (see SendFormStats::forReply)
+	///
+	////////////////////////////////////////////////////////////
+	void setStatsEnabled( bool enabled );
+	
+	////////////////////////////////////////////////////////////
+	/// aggregate the statistics of the requests sent by post()
+	///
+	/// \param collector : the collector receiving the statistics of each finished reply (or 0), it must outlive the replies
+	///
+	/// \remarks the statistics are measured for each reply as soon as there is a collector
+	///
+	////////////////////////////////////////////////////////////
+	void setStatsCollector( SendFormStatsCollector * collector );
+	
 	////////////////////////////////////////////////////////////
 	/// send the form
 	///
 	/// \param manager : a valid QNetworkAccessManager that will be used to
 	///
-	/// \return return the QNetworkReply corresponding to the request (or 0 if it's an invalid request)
+	/// \return return the QNetworkReply corresponding to the request (or 0 if it's an invalid request, if a file
+	/// can't be opened anymore, or if a body of unknown length couldn't be read entirely before sending it)
+	///
+	/// \remarks the encoded parts are kept between two calls, only the entries added or changed since then
+	/// (and the files modified on disk) are encoded again
 	///
 	////////////////////////////////////////////////////////////
 	QNetworkReply * post( QNetworkAccessManager * manager );
+	
+	////////////////////////////////////////////////////////////
+	/// send the form without blocking the calling thread on the files
+	///
+	/// \param manager : a valid QNetworkAccessManager, living in the calling thread
+	/// \param pool : the pool whose threads open, stat and read the files (0 for QThreadPool::globalInstance())
+	///
+	/// \return the pending post, emitting posted() once the QNetworkReply has been issued
+	///
+	/// \remarks the form is copied, it can be modified or destroyed right after the call
+	/// \remarks the body is read ahead by chunks on the pool and streamed, so it can't be sent again on a redirection or an authentication
+	/// \remarks the devices added with addDevice() are read on the thread owning them, the body of a form with devices
+	/// is created on the pool up to its devices, which are appended to it from the calling thread
+	///
+	////////////////////////////////////////////////////////////
+	SendFormAsyncPost * postAsync( QNetworkAccessManager * manager, QThreadPool * pool = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// compute the size of the body that post() would send, without reading the files (see setContentSniffing)
+	///
+	/// \return the value of the "Content-Length" header post() would set, or -1 if a device has an unknown size
+	///
+	/// \remarks the files are only stat'ed, so the size is exact as long as they are not modified before post() is called
+	/// \remarks with content sniffing, the content type of a file is part of the size: the first bytes of the files
+	/// sniffed by post() are read, once, the type being kept for the next calls while the file isn't modified
+	/// \remarks when the body is compressed, this is the size before compression
+	///
+	////////////////////////////////////////////////////////////
+	qint64 plannedSize() const;
 
 private:
+	friend class SendFormAsyncPost;
+	friend class SendFormOutbox;
+	friend class SendFormTest;
+	
 	QNetworkRequest m_request;
 	QUrl m_destination;
-	QHash< QString, QString > m_files;
-	QHash< QString, QString > m_fields;
+	FormEntries m_files;
+	FormEntries m_fields;
 	bool m_forcemultipart;
+	int m_compressionLevel;
+	Compression m_compression;
+	qint64 m_memoryBudget;
+	bool m_expectContinue;
+	int m_continueTimeout;
+	UploadScheduler * m_uploadScheduler;
+	int m_uploadWeight;
+	int m_digests;
+	DigestPlacement m_digestPlacement;
+	bool m_contentSniffing;
+	bool m_statsEnabled;
+	SendFormStatsCollector * m_statsCollector;
+	
+	struct Device
+	{
+		QString name;
+		QIODevice * device;
+		QString filename;
+		QByteArray mime;
+		qint64 size;
+		
+		qint64 bodySize() const;
+	};
+	QList< Device > m_devices;
+	
+	struct Data
+	{
+		QString name;
+		QByteArray data;
+		QString filename;
+		QByteArray mime;
+	};
+	QList< Data > m_data;
+	
+	// encoded segments reused by the next posts until the entry they come from changes
+	struct FileCache
+	{
+		FileCache() : size( 0 ), digests( 0 ) {}
+		
+		QString path;
+		qint64 size;
+		QDateTime modified;
+		QByteArray header;
+		int digests;
+		QByteArray digestHeaders;
+	};
+	mutable QByteArray m_boundary;
+	mutable QHash< QByteArray, FileCache > m_fileCache;
+	mutable QByteArray m_urlEncodedCache;
 	
-	QByteArray generateBoundary();
+	SendFormStats * createStats() const;
+	QIODevice * prepareBody( qint64 & length, SendFormStats * stats, MultipartBodyDevice ** multipart = 0, MultipartBodyDevice * parts = 0 );
+	QNetworkReply * send( QNetworkAccessManager * manager, QIODevice * body, qint64 length, SendFormStats * stats, MultipartBodyDevice * multipart );
+	QIODevice * createBody( qint64 & length, QList< QPair< QString, qint64 > > * partSizes = 0, MultipartBodyDevice * parts = 0 );
+	MultipartBodyDevice * createParts( QList< QPair< QString, qint64 > > * partSizes ) const;
+	bool isMultipart() const;
+	bool sizeKnown() const;
+	bool canSpool() const;
+	QByteArray fileHeader( const QByteArray & boundary, const QString & name, const QFileInfo & fi ) const;
+	QByteArray partHeader( const QByteArray & boundary, const QString & name, const QString & filename, const QByteArray & mime ) const;
+	QByteArray fieldPart( const QByteArray & boundary, const QByteArray & name, const QByteArray & value ) const;
+	QByteArray closingBoundary( const QByteArray & boundary ) const;
+	QByteArray urlEncodedBody() const;
+	QByteArray boundary() const;
+	QByteArray cachedFileHeader( const QByteArray & name, const QFileInfo & fi ) const;
+	FileCache & cachedFile( const QByteArray & name, const QFileInfo & fi ) const;
+	void hashFiles() const;
+	qint64 digestSize( const QByteArray & name ) const;
+	QByteArray cachedFieldPart( int i );
 	
-	static void init();
-	static bool m_initialized;
-	static QHash< QString, QByteArray > mimeTypes;
+	static QByteArray generateBoundary();
+	static const char * mimeType( const QString & suffix );
+	static QByteArray digestFieldName( const QByteArray & name, PartDigest::Algorithm algorithm );
+	static QByteArray withDigestHeaders( const QByteArray & header, const QByteArray & digestHeaders );
 };
 
 #endif
@@ -0,0 +1,37 @@
+# sources of the library, shared by the library target and the tests
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += $$PWD/SendForm.cpp \
+	$$PWD/BodySpool.cpp \
+	$$PWD/CompressedBodyDevice.cpp \
+	$$PWD/ContentSniffer.cpp \
+	$$PWD/ContinueGateDevice.cpp \
+	$$PWD/FormEntries.cpp \
+	$$PWD/FormUrlEncoder.cpp \
+	$$PWD/MultipartBodyDevice.cpp \
+	$$PWD/PartDigest.cpp \
+	$$PWD/ReadAheadDevice.cpp \
+	$$PWD/SendFormAsyncPost.cpp \
+	$$PWD/SendFormBatch.cpp \
+	$$PWD/SendFormOutbox.cpp \
+	$$PWD/SendFormStats.cpp \
+	$$PWD/ThrottledBodyDevice.cpp \
+	$$PWD/UploadScheduler.cpp
+HEADERS += $$PWD/SendForm.h \
+	$$PWD/BodySpool.h \
+	$$PWD/CompressedBodyDevice.h \
+	$$PWD/ContentSniffer.h \
+	$$PWD/ContinueGateDevice.h \
+	$$PWD/FormEntries.h \
+	$$PWD/FormUrlEncoder.h \
+	$$PWD/MultipartBodyDevice.h \
+	$$PWD/PartDigest.h \
+	$$PWD/ReadAheadDevice.h \
+	$$PWD/SendFormAsyncPost.h \
+	$$PWD/SendFormBatch.h \
+	$$PWD/SendFormOutbox.h \
+	$$PWD/SendFormStats.h \
+	$$PWD/ThrottledBodyDevice.h \
+	$$PWD/UploadScheduler.h
+LIBS += -lz
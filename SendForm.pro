@@ -1,6 +1,5 @@
 TEMPLATE = lib
 CONFIG += dll
-SOURCES = SendForm.cpp
-HEADERS = SendForm.h
+include(SendForm.pri)
 QT = core network
 TARGET = SendForm
\ No newline at end of file
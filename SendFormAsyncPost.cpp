@@ -0,0 +1,141 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "SendFormAsyncPost.h"
+#include "MultipartBodyDevice.h"
+#include "ReadAheadDevice.h"
+#include "SendFormStats.h"
+
+#include <QMetaObject>
+#include <QRunnable>
+
+////////////////////////////////////////////////////////////
+/// create the body of a pending post on the pool
+////////////////////////////////////////////////////////////
+class SendFormAsyncTask : public QRunnable
+{
+public:
+	SendFormAsyncTask( SendFormAsyncPost * post ) : m_post( post )
+	{
+	}
+	
+	void run()
+	{
+		m_post->prepareBody();
+		QMetaObject::invokeMethod( m_post, "bodyPrepared", Qt::QueuedConnection );
+	}
+
+private:
+	SendFormAsyncPost * m_post;
+};
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+SendFormAsyncPost::SendFormAsyncPost( const SendForm & form, QNetworkAccessManager * manager, QThreadPool * pool ) : m_form( form )
+{
+	m_manager = manager;
+	m_pool = pool;
+	m_stats = 0;
+	m_body = 0;
+	m_multipart = 0;
+	m_parts = 0;
+	m_length = -1;
+	m_reply = 0;
+	
+	// the devices are read by the body from the thread owning them, so they are appended to it there
+	m_callerThread = !form.m_devices.isEmpty();
+	m_readAhead = !m_callerThread && !form.m_files.isEmpty();
+}
+
+////////////////////////////////////////////////////////////
+/// get the reply of the request
+////////////////////////////////////////////////////////////
+QNetworkReply * SendFormAsyncPost::reply() const
+{
+	return m_reply;
+}
+
+////////////////////////////////////////////////////////////
+/// prepare the body on the pool
+////////////////////////////////////////////////////////////
+void SendFormAsyncPost::start()
+{
+	m_stats = m_form.createStats();
+	m_pool->start( new SendFormAsyncTask( this ) );
+}
+
+////////////////////////////////////////////////////////////
+/// stat the files and encode the body (called on the pool)
+////////////////////////////////////////////////////////////
+void SendFormAsyncPost::prepareBody()
+{
+	if( m_callerThread )
+	{
+		// the files are stat'ed and their parts created here, bodyPrepared() appends the devices and the fields
+		m_parts = m_form.createParts( m_stats ? &m_stats->m_partSizes : 0 );
+		if( m_parts ) m_parts->moveToThread( thread() );
+		return;
+	}
+	
+	m_body = m_form.prepareBody( m_length, m_stats, &m_multipart );
+	if( !m_body ) return;
+	
+	if( m_readAhead )
+	{
+		// the first chunks are read right away, so they are ready when the request is issued
+		ReadAheadDevice * readAhead = new ReadAheadDevice( m_body, m_length, m_pool );
+		readAhead->moveToThread( thread() );
+		readAhead->open( QIODevice::ReadOnly );
+		
+		// the multipart body is read on the pool from now on, the time spent reading it is the one
+		// of its files (a spooled body has already been read, its read time is in the statistics)
+		if( m_stats && m_multipart ) m_stats->m_readAhead = readAhead;
+		
+		m_body = readAhead;
+		m_multipart = 0;
+	}
+	else
+	{
+		// the body is read by the network layer in the thread of the caller
+		m_body->moveToThread( thread() );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// issue the request once the body is ready
+////////////////////////////////////////////////////////////
+void SendFormAsyncPost::bodyPrepared()
+{
+	// a file that couldn't be read on the pool fails the post, like in post()
+	if( m_callerThread ) m_body = m_parts ? m_form.prepareBody( m_length, m_stats, &m_multipart, m_parts ) : 0;
+	
+	if( !m_body )
+	{
+		delete m_stats;
+		m_stats = 0;
+		
+		emit posted( 0 );
+		deleteLater();
+		return;
+	}
+	
+	m_reply = m_form.send( m_manager, m_body, m_length, m_stats, m_multipart );
+	setParent( m_reply );
+	
+	emit posted( m_reply );
+}
@@ -0,0 +1,90 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_ASYNC_POST_WITH_QT
+#define SEND_FORM_ASYNC_POST_WITH_QT
+
+#include "SendForm.h"
+
+#include <QIODevice>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QObject>
+#include <QThreadPool>
+
+class MultipartBodyDevice;
+class SendFormStats;
+
+////////////////////////////////////////////////////////////
+/// SendFormAsyncPost is a form being prepared on a thread pool by SendForm::postAsync().
+///
+/// The files are opened, stat'ed and their first chunks read on the pool, then the request
+/// is issued from the thread that called postAsync(). The devices added with addDevice() belong
+/// to that thread: the body of a form with devices is created on the pool up to its devices
+/// (the files stat'ed, and hashed for the digests sent in the headers), then the devices and
+/// the fields are appended to it from that thread. Once posted() has been emitted,
+/// the SendFormAsyncPost is a child of the reply and is destroyed with it,
+/// it must not be destroyed before.
+////////////////////////////////////////////////////////////
+class SendFormAsyncPost : public QObject
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// get the reply of the request
+	///
+	/// \return the reply, or 0 until posted() has been emitted
+	///
+	////////////////////////////////////////////////////////////
+	QNetworkReply * reply() const;
+
+signals:
+	////////////////////////////////////////////////////////////
+	/// emitted when the request has been given to the QNetworkAccessManager
+	///
+	/// \param reply : the reply of the request, destroyed by the caller like the one returned by SendForm::post(),
+	/// 0 if the body couldn't be read (the SendFormAsyncPost is then destroyed when the control returns to the event loop)
+	///
+	////////////////////////////////////////////////////////////
+	void posted( QNetworkReply * reply );
+
+private slots:
+	void bodyPrepared();
+
+private:
+	friend class SendForm;
+	friend class SendFormAsyncTask;
+	
+	SendFormAsyncPost( const SendForm & form, QNetworkAccessManager * manager, QThreadPool * pool );
+	void start();
+	void prepareBody();
+	
+	SendForm m_form;
+	QNetworkAccessManager * m_manager;
+	QThreadPool * m_pool;
+	SendFormStats * m_stats;
+	QIODevice * m_body;
+	MultipartBodyDevice * m_multipart;
+	MultipartBodyDevice * m_parts;
+	qint64 m_length;
+	bool m_readAhead;
+	bool m_callerThread;
+	QNetworkReply * m_reply;
+};
+
+#endif
@@ -0,0 +1,237 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "SendFormBatch.h"
+
+#include <QMetaObject>
+#include <QStringList>
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+SendFormBatch::SendFormBatch( QNetworkAccessManager * manager, QObject * parent ) : QObject( parent )
+{
+	m_manager = manager;
+	m_maxConcurrentPerHost = 6;
+	m_queued = 0;
+	
+	resetStatistics();
+}
+
+////////////////////////////////////////////////////////////
+/// set the number of requests that can be in flight for the same host
+////////////////////////////////////////////////////////////
+void SendFormBatch::setMaxConcurrentPerHost( int count )
+{
+	m_maxConcurrentPerHost = qMax( 1, count );
+	
+	// use the new room right away
+	QStringList hosts = m_queues.keys();
+	foreach( const QString & host, hosts )
+	{
+		startNext( host );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// get the number of requests that can be in flight for the same host
+////////////////////////////////////////////////////////////
+int SendFormBatch::maxConcurrentPerHost() const
+{
+	return m_maxConcurrentPerHost;
+}
+
+////////////////////////////////////////////////////////////
+/// add a form to the batch
+////////////////////////////////////////////////////////////
+void SendFormBatch::enqueue( const SendForm & form )
+{
+	if( !m_elapsed.isValid() ) m_elapsed.start();
+	
+	QString host = hostKey( form.destination() );
+	m_queues[ host ].enqueue( form );
+	m_queued++;
+	
+	startNext( host );
+}
+
+int SendFormBatch::pendingCount() const
+{
+	return m_queued + m_jobs.count();
+}
+
+int SendFormBatch::completedCount() const
+{
+	return m_completed;
+}
+
+int SendFormBatch::failedCount() const
+{
+	return m_failed;
+}
+
+qint64 SendFormBatch::bytesSent() const
+{
+	return m_bytesSent;
+}
+
+double SendFormBatch::requestsPerSecond() const
+{
+	qint64 time = activeTime();
+	return time ? m_completed * 1000.0 / time : 0.0;
+}
+
+double SendFormBatch::bytesPerSecond() const
+{
+	qint64 time = activeTime();
+	return time ? m_bytesSent * 1000.0 / time : 0.0;
+}
+
+double SendFormBatch::averageLatency() const
+{
+	return m_completed ? double( m_totalLatency ) / m_completed : 0.0;
+}
+
+qint64 SendFormBatch::maximumLatency() const
+{
+	return m_maximumLatency;
+}
+
+////////////////////////////////////////////////////////////
+/// reset all the counters
+////////////////////////////////////////////////////////////
+void SendFormBatch::resetStatistics()
+{
+	m_busyTime = 0;
+	m_completed = 0;
+	m_failed = 0;
+	m_bytesSent = 0;
+	m_totalLatency = 0;
+	m_maximumLatency = 0;
+	
+	if( pendingCount() ) m_elapsed.start();
+	else m_elapsed.invalidate();
+}
+
+////////////////////////////////////////////////////////////
+/// a reply has finished, start the next form of its host
+////////////////////////////////////////////////////////////
+void SendFormBatch::replyFinished()
+{
+	QNetworkReply * reply = qobject_cast< QNetworkReply * >( sender() );
+	if( !reply || !m_jobs.contains( reply ) ) return;
+	
+	Job job = m_jobs.take( reply );
+	qint64 latency = job.timer.elapsed();
+	
+	m_completed++;
+	if( reply->error() != QNetworkReply::NoError ) m_failed++;
+	m_bytesSent += job.bytes;
+	m_totalLatency += latency;
+	m_maximumLatency = qMax( m_maximumLatency, latency );
+	
+	if( --m_inFlight[ job.host ] == 0 && !m_queues.contains( job.host ) )
+	{
+		m_inFlight.remove( job.host );
+	}
+	
+	emit formFinished( reply );
+	reply->deleteLater();
+	
+	startNext( job.host );
+	checkFinished();
+}
+
+////////////////////////////////////////////////////////////
+/// emit finished() once nothing is left to send
+////////////////////////////////////////////////////////////
+void SendFormBatch::checkFinished()
+{
+	if( pendingCount() || !m_elapsed.isValid() ) return;
+	
+	m_busyTime += m_elapsed.elapsed();
+	m_elapsed.invalidate();
+	
+	emit finished();
+}
+
+////////////////////////////////////////////////////////////
+/// send the forms of a host while there is room for them
+////////////////////////////////////////////////////////////
+void SendFormBatch::startNext( const QString & host )
+{
+	QHash< QString, QQueue< SendForm > >::iterator queue = m_queues.find( host );
+	if( queue == m_queues.end() ) return;
+	
+	// the forms are announced once the loop is done with the queue, a slot
+	// calling enqueue() may change m_queues and m_inFlight
+	QList< SendForm > notSent;
+	
+	int & inFlight = m_inFlight[ host ];
+	while( inFlight < m_maxConcurrentPerHost && !queue->isEmpty() )
+	{
+		SendForm form = queue->dequeue();
+		m_queued--;
+		
+		Job job;
+		job.host = host;
+		job.timer.start();
+		
+		QNetworkReply * reply = form.post( m_manager );
+		if( !reply )
+		{
+			m_completed++;
+			m_failed++;
+			notSent.append( form );
+			continue;
+		}
+		
+		job.bytes = reply->request().rawHeader( "Content-Length" ).toLongLong();
+		
+		m_jobs.insert( reply, job );
+		inFlight++;
+		
+		connect( reply, SIGNAL( finished() ), this, SLOT( replyFinished() ) );
+	}
+	
+	if( queue->isEmpty() )
+	{
+		m_queues.erase( queue );
+		if( !inFlight ) m_inFlight.remove( host );
+	}
+	
+	if( notSent.isEmpty() ) return;
+	
+	for(int i = 0;i < notSent.size();i++)
+		emit formNotSent( notSent.at( i ) );
+	
+	// the batch may be over, but not from within enqueue()
+	QMetaObject::invokeMethod( this, "checkFinished", Qt::QueuedConnection );
+}
+
+qint64 SendFormBatch::activeTime() const
+{
+	return m_busyTime + ( m_elapsed.isValid() ? m_elapsed.elapsed() : 0 );
+}
+
+////////////////////////////////////////////////////////////
+/// requests to the same scheme, host and port share their connections
+////////////////////////////////////////////////////////////
+QString SendFormBatch::hostKey( const QUrl & url )
+{
+	return url.scheme().toLower() + "://" + url.host().toLower() + ":" + QString::number( url.port( -1 ) );
+}
@@ -0,0 +1,190 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_BATCH_WITH_QT
+#define SEND_FORM_BATCH_WITH_QT
+
+#include "SendForm.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+
+////////////////////////////////////////////////////////////
+/// SendFormBatch sends a lot of forms while limiting the number of requests in flight for each host.
+///
+/// All the forms share the same QNetworkAccessManager so the connections are kept alive between requests.
+////////////////////////////////////////////////////////////
+class SendFormBatch : public QObject
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param manager : the QNetworkAccessManager used to send all the forms
+	/// \param parent : the parent of the batch
+	///
+	////////////////////////////////////////////////////////////
+	SendFormBatch( QNetworkAccessManager * manager, QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// set the number of requests that can be in flight for the same host
+	///
+	/// \param count : the maximum number of requests (6 by default, the number of connections QNetworkAccessManager opens per host)
+	///
+	/// \remarks the forms sent over HTTP/2 are multiplexed on one connection, this is then the number of concurrent streams,
+	/// it can be raised up to the limit announced by the server (often 100)
+	///
+	/// \see SendForm::setHttp2
+	///
+	////////////////////////////////////////////////////////////
+	void setMaxConcurrentPerHost( int count );
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of requests that can be in flight for the same host
+	///
+	/// \see setMaxConcurrentPerHost
+	///
+	////////////////////////////////////////////////////////////
+	int maxConcurrentPerHost() const;
+	
+	////////////////////////////////////////////////////////////
+	/// add a form to the batch, it is sent as soon as there is room for its host
+	///
+	/// \param form : the form to send
+	///
+	////////////////////////////////////////////////////////////
+	void enqueue( const SendForm & form );
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of forms waiting to be sent or in flight
+	///
+	////////////////////////////////////////////////////////////
+	int pendingCount() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of forms whose reply has finished (with or without error)
+	///
+	////////////////////////////////////////////////////////////
+	int completedCount() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of forms whose reply has finished with an error
+	///
+	////////////////////////////////////////////////////////////
+	int failedCount() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body sent by the completed forms
+	///
+	////////////////////////////////////////////////////////////
+	qint64 bytesSent() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of completed forms per second while the batch had forms to send
+	///
+	////////////////////////////////////////////////////////////
+	double requestsPerSecond() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body sent per second while the batch had forms to send
+	///
+	////////////////////////////////////////////////////////////
+	double bytesPerSecond() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the average time between post() and the end of the reply, in milliseconds
+	///
+	////////////////////////////////////////////////////////////
+	double averageLatency() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the longest time between post() and the end of the reply, in milliseconds
+	///
+	////////////////////////////////////////////////////////////
+	qint64 maximumLatency() const;
+	
+	////////////////////////////////////////////////////////////
+	/// reset all the counters
+	///
+	////////////////////////////////////////////////////////////
+	void resetStatistics();
+
+signals:
+	////////////////////////////////////////////////////////////
+	/// emitted when the reply of a form has finished
+	///
+	/// \param reply : the reply, it is deleted when the control returns to the event loop
+	///
+	////////////////////////////////////////////////////////////
+	void formFinished( QNetworkReply * reply );
+	
+	////////////////////////////////////////////////////////////
+	/// emitted when a form couldn't be sent because SendForm::post() returned 0,
+	/// it is counted as completed and failed
+	///
+	/// \param form : the form
+	///
+	////////////////////////////////////////////////////////////
+	void formNotSent( const SendForm & form );
+	
+	////////////////////////////////////////////////////////////
+	/// emitted when all the forms have been sent and their replies have finished
+	///
+	////////////////////////////////////////////////////////////
+	void finished();
+
+private slots:
+	void replyFinished();
+	void checkFinished();
+
+private:
+	struct Job
+	{
+		QString host;
+		qint64 bytes;
+		QElapsedTimer timer;
+	};
+	
+	QNetworkAccessManager * m_manager;
+	int m_maxConcurrentPerHost;
+	QHash< QString, QQueue< SendForm > > m_queues;
+	QHash< QString, int > m_inFlight;
+	QHash< QNetworkReply *, Job > m_jobs;
+	int m_queued;
+	
+	QElapsedTimer m_elapsed;
+	qint64 m_busyTime;
+	int m_completed;
+	int m_failed;
+	qint64 m_bytesSent;
+	qint64 m_totalLatency;
+	qint64 m_maximumLatency;
+	
+	void startNext( const QString & host );
+	qint64 activeTime() const;
+	
+	static QString hostKey( const QUrl & url );
+};
+
+#endif
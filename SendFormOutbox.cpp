@@ -0,0 +1,634 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "SendFormOutbox.h"
+#include "SendFormBatch.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkRequest>
+#include <QtEndian>
+#include <cstring>
+#include <zlib.h>
+
+#if QT_VERSION >= 0x050100
+#include <QSaveFile>
+#endif
+
+#if defined( Q_OS_WIN )
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// every record starts with the magic number, then the size and the CRC-32 of its content
+static const char recordMagic[4] = { 'S', 'F', 'o', 'b' };
+static const int recordHeaderSize = 12;
+
+// version of the content of a record (1 had no digests, "Expect", sniffing or HTTP/2 options)
+static const quint8 recordVersion = 2;
+
+// the HTTP/2 attributes of the Qt version building the outbox, -1 when it doesn't have them
+#if QT_VERSION >= 0x050F00
+static const int http2AllowedAttribute = QNetworkRequest::Http2AllowedAttribute;
+#elif QT_VERSION >= 0x050800
+static const int http2AllowedAttribute = QNetworkRequest::HTTP2AllowedAttribute;
+#else
+static const int http2AllowedAttribute = -1;
+#endif
+
+#if QT_VERSION >= 0x050B00
+static const int http2DirectAttribute = QNetworkRequest::Http2DirectAttribute;
+#else
+static const int http2DirectAttribute = -1;
+#endif
+
+// the request of a replayed form carries the offset of its record
+static const QNetworkRequest::Attribute recordOffsetAttribute = QNetworkRequest::UserMax;
+
+// the content of the records appended, so it fits in a QByteArray when it is written and
+// when its form is rebuilt (the files saved by their content count for most of it)
+static const qint64 maximumRecordSize = 256 * 1024 * 1024;
+
+// an outbox that can't be mapped is read in memory up to this size
+static const qint64 maximumReadSize = 1024 * 1024 * 1024;
+
+// size of the chunks copied when the outbox is compacted
+static const int copyChunkSize = 64 * 1024;
+
+////////////////////////////////////////////////////////////
+/// wait until what has been written to a file is on the disk
+////////////////////////////////////////////////////////////
+static bool syncFile( QFile & file )
+{
+#if defined( Q_OS_WIN )
+	return FlushFileBuffers( reinterpret_cast< HANDLE >( _get_osfhandle( file.handle() ) ) ) != 0;
+#else
+	return fsync( file.handle() ) == 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// a boolean attribute of a request: -1 if it isn't set, so the default of the Qt version sending it applies
+////////////////////////////////////////////////////////////
+static qint8 attributeState( const QNetworkRequest & request, int attribute )
+{
+	if( attribute < 0 ) return -1;
+	
+	QVariant value = request.attribute( QNetworkRequest::Attribute( attribute ) );
+	return value.isValid() ? qint8( value.toBool() ) : qint8( -1 );
+}
+
+static void setAttributeState( QNetworkRequest & request, int attribute, qint8 state )
+{
+	if( attribute >= 0 && state >= 0 ) request.setAttribute( QNetworkRequest::Attribute( attribute ), state != 0 );
+}
+
+////////////////////////////////////////////////////////////
+/// wait until the entry of a new or renamed file is on the disk
+////////////////////////////////////////////////////////////
+static void syncDirectory( const QString & path )
+{
+#if defined( Q_OS_WIN )
+	// NTFS journals the entries of the directories
+	Q_UNUSED( path );
+#else
+	int directory = open( QFile::encodeName( QFileInfo( path ).absolutePath() ).constData(), O_RDONLY );
+	if( directory < 0 ) return;
+	
+	fsync( directory );
+	close( directory );
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+SendFormOutbox::SendFormOutbox( const QString & path )
+{
+	m_path = path;
+}
+
+////////////////////////////////////////////////////////////
+/// get the path of the outbox file
+////////////////////////////////////////////////////////////
+const QString & SendFormOutbox::path() const
+{
+	return m_path;
+}
+
+////////////////////////////////////////////////////////////
+/// save a form at the end of the outbox
+////////////////////////////////////////////////////////////
+bool SendFormOutbox::append( const SendForm & form, bool inlineFiles )
+{
+	QByteArray record( recordHeaderSize, Qt::Uninitialized );
+	if( !serialize( form, inlineFiles, record ) ) return false;
+	
+	if( record.size() - recordHeaderSize > maximumRecordSize )
+	{
+		m_errorString = QString::fromLatin1( "The form is too large to be saved in the outbox" );
+		return false;
+	}
+	
+	uchar * header = reinterpret_cast< uchar * >( record.data() );
+	std::memcpy( header, recordMagic, 4 );
+	qToLittleEndian< quint32 >( quint32( record.size() - recordHeaderSize ), header + 4 );
+	qToLittleEndian< quint32 >( quint32( crc32( 0, header + recordHeaderSize, uInt( record.size() - recordHeaderSize ) ) ), header + 8 );
+	
+	return write( record );
+}
+
+////////////////////////////////////////////////////////////
+/// send the forms saved in the outbox
+////////////////////////////////////////////////////////////
+qint64 SendFormOutbox::replay( SendFormBatch * batch, qint64 from, int maxForms )
+{
+	recover();
+	
+	QFile file( m_path );
+	if( !file.exists() ) return from;
+	
+	if( !file.open( QIODevice::ReadOnly ) )
+	{
+		m_errorString = file.errorString();
+		return -1;
+	}
+	
+	qint64 size = file.size();
+	if( from >= size ) return from;
+	
+	// the records are read in place, only the forms enqueued own a copy of their content
+	QByteArray content;
+	const uchar * data = file.map( 0, size );
+	if( !data )
+	{
+		if( size > maximumReadSize )
+		{
+			m_errorString = QString::fromLatin1( "The outbox is too large to be read without mapping it" );
+			return -1;
+		}
+		
+		content = file.readAll();
+		data = reinterpret_cast< const uchar * >( content.constData() );
+		size = content.size();
+	}
+	
+	qint64 offset = from;
+	int count = 0;
+	while( maxForms < 0 || count < maxForms )
+	{
+		qint64 payloadOffset, payloadSize;
+		qint64 record = nextRecord( data, size, offset, payloadOffset, payloadSize );
+		if( record < 0 )
+		{
+			offset = size;
+			break;
+		}
+		
+		offset = payloadOffset + payloadSize;
+		
+		QByteArray payload = QByteArray::fromRawData( reinterpret_cast< const char * >( data + payloadOffset ), int( payloadSize ) );
+		if( enqueue( payload, record, batch ) ) count++;
+	}
+	
+	return offset;
+}
+
+////////////////////////////////////////////////////////////
+/// save again a form that has been replayed
+////////////////////////////////////////////////////////////
+bool SendFormOutbox::requeue( qint64 offset )
+{
+	recover();
+	
+	QFile file( m_path );
+	if( !file.open( QIODevice::ReadOnly ) )
+	{
+		m_errorString = file.errorString();
+		return false;
+	}
+	
+	// the record is copied as it is, after checking it is still there
+	QByteArray record;
+	if( offset >= 0 && offset + recordHeaderSize <= file.size() && file.seek( offset ) )
+	{
+		record = file.read( recordHeaderSize );
+		
+		quint32 length = record.size() == recordHeaderSize ? qFromLittleEndian< quint32 >( reinterpret_cast< const uchar * >( record.constData() ) + 4 ) : 0;
+		if( length <= quint64( file.size() - offset - recordHeaderSize ) ) record += file.read( length );
+	}
+	file.close();
+	
+	qint64 payloadOffset, payloadSize;
+	if( record.size() < recordHeaderSize || nextRecord( reinterpret_cast< const uchar * >( record.constData() ), record.size(), 0, payloadOffset, payloadSize ) != 0 )
+	{
+		m_errorString = QString::fromLatin1( "There is no record at this offset" );
+		return false;
+	}
+	
+	return write( record );
+}
+
+////////////////////////////////////////////////////////////
+/// remove forms from the outbox
+////////////////////////////////////////////////////////////
+bool SendFormOutbox::clear( qint64 upTo )
+{
+	recover();
+	
+	QFile file( m_path );
+	if( !file.exists() ) return true;
+	
+	if( !file.open( QIODevice::ReadWrite ) )
+	{
+		m_errorString = file.errorString();
+		return false;
+	}
+	
+	if( upTo < 0 || upTo >= file.size() )
+	{
+		if( !file.resize( 0 ) || !syncFile( file ) )
+		{
+			m_errorString = file.errorString();
+			return false;
+		}
+		
+		return true;
+	}
+	
+	if( upTo == 0 ) return true;
+	
+	// the records left are copied to a new file replacing the outbox,
+	// so a crash leaves either the old or the new outbox complete
+#if QT_VERSION >= 0x050100
+	QSaveFile copy( m_path );
+#else
+	QFile copy( m_path + ".new" );
+#endif
+	if( !file.seek( upTo ) )
+	{
+		m_errorString = file.errorString();
+		return false;
+	}
+	
+	if( !copy.open( QIODevice::WriteOnly ) )
+	{
+		m_errorString = copy.errorString();
+		return false;
+	}
+	
+	QByteArray chunk( copyChunkSize, Qt::Uninitialized );
+	for(;;)
+	{
+		qint64 read = file.read( chunk.data(), chunk.size() );
+		if( read < 0 )
+		{
+			m_errorString = file.errorString();
+			return false;
+		}
+		if( read == 0 ) break;
+		
+		if( copy.write( chunk.constData(), read ) != read )
+		{
+			m_errorString = copy.errorString();
+			return false;
+		}
+	}
+	file.close();
+	
+#if QT_VERSION >= 0x050100
+	// the new file is flushed to the disk before it replaces the outbox
+	if( !copy.commit() )
+	{
+		m_errorString = copy.errorString();
+		return false;
+	}
+#else
+	if( !copy.flush() || !syncFile( copy ) )
+	{
+		m_errorString = copy.errorString();
+		copy.remove();
+		return false;
+	}
+	copy.close();
+	
+	// QFile::rename() doesn't replace an existing file: the outbox is moved aside until
+	// the copy has taken its place, recover() finishes the job after a crash
+	QString backup = m_path + ".old";
+	QFile::remove( backup );
+	if( !QFile::rename( m_path, backup ) )
+	{
+		m_errorString = QString::fromLatin1( "Cannot rename the outbox" );
+		copy.remove();
+		return false;
+	}
+	
+	if( !copy.rename( m_path ) )
+	{
+		m_errorString = copy.errorString();
+		QFile::rename( backup, m_path );
+		copy.remove();
+		return false;
+	}
+	
+	syncDirectory( m_path );
+	QFile::remove( backup );
+#endif
+	
+	syncDirectory( m_path );
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// get the offset of the record a replayed form comes from
+////////////////////////////////////////////////////////////
+qint64 SendFormOutbox::recordOffset( const QNetworkReply * reply )
+{
+	if( !reply ) return -1;
+	
+	QVariant offset = reply->request().attribute( recordOffsetAttribute );
+	return offset.isValid() ? offset.toLongLong() : -1;
+}
+
+qint64 SendFormOutbox::recordOffset( const SendForm & form )
+{
+	QVariant offset = form.m_request.attribute( recordOffsetAttribute );
+	return offset.isValid() ? offset.toLongLong() : -1;
+}
+
+////////////////////////////////////////////////////////////
+/// get the description of the last error
+////////////////////////////////////////////////////////////
+const QString & SendFormOutbox::errorString() const
+{
+	return m_errorString;
+}
+
+////////////////////////////////////////////////////////////
+/// write a record at the end of the outbox and flush it to the disk
+////////////////////////////////////////////////////////////
+bool SendFormOutbox::write( const QByteArray & record )
+{
+	recover();
+	
+	QFile file( m_path );
+	bool created = !file.exists();
+	
+	// the record is written in a single call, so a crash can only cut the last one
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered ) )
+	{
+		m_errorString = file.errorString();
+		return false;
+	}
+	
+	if( file.write( record ) != record.size() )
+	{
+		m_errorString = file.errorString();
+		return false;
+	}
+	
+	// a form is only saved once it can't be lost by a power failure
+	if( !syncFile( file ) )
+	{
+		m_errorString = QString::fromLatin1( "Cannot flush the outbox to the disk" );
+		return false;
+	}
+	
+	if( created ) syncDirectory( m_path );
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// put back the outbox a clear() cut by a crash has left aside
+////////////////////////////////////////////////////////////
+void SendFormOutbox::recover()
+{
+	QString copy = m_path + ".new";
+	QString backup = m_path + ".old";
+	
+	if( !QFile::exists( m_path ) )
+	{
+		// the copy is complete once the outbox has been moved aside
+		if( QFile::exists( backup ) && !QFile::rename( QFile::exists( copy ) ? copy : backup, m_path ) ) return;
+		
+		syncDirectory( m_path );
+	}
+	
+	// the outbox is complete, what is left of a clear() is stale
+	QFile::remove( copy );
+	QFile::remove( backup );
+}
+
+////////////////////////////////////////////////////////////
+/// write the content of a record after the data already in payload
+////////////////////////////////////////////////////////////
+bool SendFormOutbox::serialize( const SendForm & form, bool inlineFiles, QByteArray & payload )
+{
+	if( !form.m_devices.isEmpty() )
+	{
+		m_errorString = QString::fromLatin1( "A form with devices can't be saved" );
+		return false;
+	}
+	
+	QDataStream stream( &payload, QIODevice::WriteOnly | QIODevice::Append );
+	stream.setVersion( QDataStream::Qt_4_6 );
+	
+	stream << recordVersion << form.m_destination;
+	
+	QList< QByteArray > headers = form.m_request.rawHeaderList();
+	stream << quint32( headers.count() );
+	foreach( const QByteArray & header, headers )
+	{
+		stream << header << form.m_request.rawHeader( header );
+	}
+	
+	stream << form.m_forcemultipart << qint32( form.m_compressionLevel ) << qint32( form.m_compression );
+	stream << qint32( form.m_digests ) << qint32( form.m_digestPlacement );
+	stream << form.m_expectContinue << qint32( form.m_continueTimeout ) << form.m_contentSniffing;
+	stream << attributeState( form.m_request, http2AllowedAttribute ) << attributeState( form.m_request, http2DirectAttribute );
+	
+	stream << quint32( form.m_fields.count() );
+	for(int i = 0;i < form.m_fields.count();i++)
+	{
+		stream << form.m_fields.name( i ) << form.m_fields.value( i );
+	}
+	
+	// the files saved by their content are sent as in-memory data
+	QList< SendForm::Data > data = form.m_data;
+	QList< QPair< QByteArray, QByteArray > > paths;
+	qint64 inlined = 0;
+	
+	for(int i = 0;i < form.m_files.count();i++)
+	{
+		if( !inlineFiles )
+		{
+			paths.append( qMakePair( form.m_files.name( i ), form.m_files.value( i ) ) );
+			continue;
+		}
+		
+		QByteArray path = form.m_files.value( i );
+		QFile file( QString::fromUtf8( path.constData(), path.size() ) );
+		if( !file.open( QIODevice::ReadOnly ) )
+		{
+			m_errorString = file.errorString();
+			return false;
+		}
+		
+		QFileInfo fi( file );
+		const char * mime = SendForm::mimeType( fi.suffix() );
+		
+		// checked before reading, the file is read in a single QByteArray
+		inlined += fi.size();
+		if( inlined > maximumRecordSize )
+		{
+			m_errorString = QString::fromLatin1( "The file is too large to be saved in the outbox: " ) + file.fileName();
+			return false;
+		}
+		
+		SendForm::Data part;
+		part.name = QString::fromUtf8( form.m_files.name( i ).constData(), form.m_files.name( i ).size() );
+		part.data = file.read( fi.size() );
+		if( part.data.size() != fi.size() )
+		{
+			m_errorString = QString::fromLatin1( "Cannot read the file: " ) + file.fileName();
+			return false;
+		}
+		
+		part.filename = fi.fileName();
+		part.mime = mime ? mime : "text/plain";
+		data.append( part );
+	}
+	
+	stream << quint32( paths.count() );
+	for(int i = 0;i < paths.count();i++)
+	{
+		stream << paths[i].first << paths[i].second;
+	}
+	
+	stream << quint32( data.count() );
+	foreach( const SendForm::Data & part, data )
+	{
+		stream << part.name << part.data << part.filename << part.mime;
+	}
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// rebuild the form of a record and enqueue it
+////////////////////////////////////////////////////////////
+bool SendFormOutbox::enqueue( const QByteArray & payload, qint64 offset, SendFormBatch * batch )
+{
+	QDataStream stream( payload );
+	stream.setVersion( QDataStream::Qt_4_6 );
+	
+	quint8 version;
+	QUrl url;
+	stream >> version >> url;
+	if( version < 1 || version > recordVersion ) return false;
+	
+	SendForm form( url );
+	
+	quint32 count;
+	stream >> count;
+	for(quint32 i = 0;i < count && stream.status() == QDataStream::Ok;i++)
+	{
+		QByteArray header, value;
+		stream >> header >> value;
+		form.setHeader( header, value );
+	}
+	
+	bool forceMultipart;
+	qint32 compressionLevel, compression;
+	stream >> forceMultipart >> compressionLevel >> compression;
+	if( forceMultipart ) form.forceMultipart();
+	form.setBodyCompression( compressionLevel, compression == SendForm::Deflate ? SendForm::Deflate : SendForm::Gzip );
+	
+	if( version >= 2 )
+	{
+		qint32 digests, digestPlacement, continueTimeout;
+		bool expectContinue, contentSniffing;
+		qint8 http2Allowed, http2Direct;
+		stream >> digests >> digestPlacement;
+		stream >> expectContinue >> continueTimeout >> contentSniffing;
+		stream >> http2Allowed >> http2Direct;
+		
+		form.setPartDigests( digests, digestPlacement == SendForm::DigestHeaders ? SendForm::DigestHeaders : SendForm::DigestFields );
+		form.setExpectContinue( expectContinue, continueTimeout );
+		form.setContentSniffing( contentSniffing );
+		setAttributeState( form.m_request, http2AllowedAttribute, http2Allowed );
+		setAttributeState( form.m_request, http2DirectAttribute, http2Direct );
+	}
+	
+	stream >> count;
+	for(quint32 i = 0;i < count && stream.status() == QDataStream::Ok;i++)
+	{
+		QByteArray name, value;
+		stream >> name >> value;
+		form.addField( name, value );
+	}
+	
+	stream >> count;
+	for(quint32 i = 0;i < count && stream.status() == QDataStream::Ok;i++)
+	{
+		QByteArray name, path;
+		stream >> name >> path;
+		form.addFile( QString::fromUtf8( name.constData(), name.size() ), QString::fromUtf8( path.constData(), path.size() ) );
+	}
+	
+	stream >> count;
+	for(quint32 i = 0;i < count && stream.status() == QDataStream::Ok;i++)
+	{
+		QString name, filename;
+		QByteArray data, mime;
+		stream >> name >> data >> filename >> mime;
+		form.addData( name, data, filename, mime );
+	}
+	
+	if( stream.status() != QDataStream::Ok ) return false;
+	
+	form.m_request.setAttribute( recordOffsetAttribute, offset );
+	batch->enqueue( form );
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// find the first valid record at or after an offset, -1 if there is none
+////////////////////////////////////////////////////////////
+qint64 SendFormOutbox::nextRecord( const uchar * data, qint64 size, qint64 offset, qint64 & payloadOffset, qint64 & payloadSize )
+{
+	for(;offset + recordHeaderSize <= size;offset++)
+	{
+		// a record cut by a crash is followed by the next complete one
+		if( std::memcmp( data + offset, recordMagic, 4 ) != 0 ) continue;
+		
+		quint32 length = qFromLittleEndian< quint32 >( data + offset + 4 );
+		quint32 checksum = qFromLittleEndian< quint32 >( data + offset + 8 );
+		if( length > quint64( size - offset - recordHeaderSize ) ) continue;
+		if( quint32( crc32( 0, data + offset + recordHeaderSize, length ) ) != checksum ) continue;
+		
+		payloadOffset = offset + recordHeaderSize;
+		payloadSize = length;
+		return offset;
+	}
+	
+	return -1;
+}
@@ -0,0 +1,153 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_OUTBOX_WITH_QT
+#define SEND_FORM_OUTBOX_WITH_QT
+
+#include "SendForm.h"
+
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QString>
+
+class SendFormBatch;
+
+////////////////////////////////////////////////////////////
+/// SendFormOutbox keeps forms in a file until they can be sent.
+///
+/// The file is append-only: each form is a record made of a magic number, the size
+/// and the CRC-32 of its content, written at once. A record cut by a crash is skipped
+/// when the outbox is read, the records after it are still found.
+///
+/// The url, the headers, the fields, the in-memory data and the files are saved,
+/// the files by their path or by their content, with the compression, the digests,
+/// "Expect: 100-continue", the content sniffing and the HTTP/2 options. The devices can't be saved.
+///
+/// Every record is flushed to the disk before append() returns. The replayed forms carry
+/// the offset of their record (see recordOffset()): the ones that fail (SendFormBatch::formFinished()
+/// with an error, SendFormBatch::formNotSent()) are saved again with requeue(), then once the batch
+/// has finished the replayed records are removed with clear( end ), end being the offset returned by replay().
+////////////////////////////////////////////////////////////
+class SendFormOutbox
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param path : the path of the outbox file, it is created by the first append()
+	///
+	////////////////////////////////////////////////////////////
+	SendFormOutbox( const QString & path );
+	
+	////////////////////////////////////////////////////////////
+	/// get the path of the outbox file
+	///
+	////////////////////////////////////////////////////////////
+	const QString & path() const;
+	
+	////////////////////////////////////////////////////////////
+	/// save a form at the end of the outbox
+	///
+	/// \param form : the form to save
+	/// \param inlineFiles : true to save the content of the files, false to save only their path
+	///
+	/// \return false if the form has devices, a file can't be read or the outbox can't be written (see errorString)
+	///
+	/// \remarks a record holds at most 256 MiB, larger files must be saved by their path
+	///
+	////////////////////////////////////////////////////////////
+	bool append( const SendForm & form, bool inlineFiles = false );
+	
+	////////////////////////////////////////////////////////////
+	/// send the forms saved in the outbox
+	///
+	/// \param batch : the batch the forms are enqueued in
+	/// \param from : the offset of the first record to read, 0 to start at the beginning
+	/// \param maxForms : the maximum number of forms to enqueue, negative for all of them
+	///
+	/// \return the offset following the last form enqueued, to give to the next call, or -1 if the outbox can't be read
+	///
+	/// \remarks the outbox is mapped in memory while it is read, or read in memory up to 1 GiB where it can't be mapped
+	/// \remarks the requests of the forms carry the offset of their record in the attribute QNetworkRequest::UserMax
+	///
+	////////////////////////////////////////////////////////////
+	qint64 replay( SendFormBatch * batch, qint64 from = 0, int maxForms = -1 );
+	
+	////////////////////////////////////////////////////////////
+	/// save again at the end of the outbox a form that has been replayed
+	///
+	/// \param offset : the offset of its record, given by recordOffset()
+	///
+	/// \return false if there is no valid record at this offset or the outbox can't be written (see errorString)
+	///
+	/// \remarks the form is sent again by a replay starting before the end of the outbox, and kept by clear( upTo )
+	///
+	////////////////////////////////////////////////////////////
+	bool requeue( qint64 offset );
+	
+	////////////////////////////////////////////////////////////
+	/// remove forms from the outbox
+	///
+	/// \param upTo : the offset up to which the records are removed (the value returned by replay()), negative for all of them
+	///
+	/// \return false if the outbox can't be rewritten (see errorString), it is then left as it was
+	///
+	/// \remarks the records after the offset (appended or requeued during the replay) are kept, they are copied
+	/// to a new file replacing the outbox, so no append() must be in progress on the same file
+	/// \remarks a clear() cut by a crash leaves the outbox as it was or cleared, the next call on the outbox finishes it
+	///
+	////////////////////////////////////////////////////////////
+	bool clear( qint64 upTo = -1 );
+	
+	////////////////////////////////////////////////////////////
+	/// get the offset of the record a replayed form comes from
+	///
+	/// \param reply : a reply of a form enqueued by replay()
+	///
+	/// \return the offset to give to requeue(), or -1 if the form doesn't come from an outbox
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 recordOffset( const QNetworkReply * reply );
+	
+	////////////////////////////////////////////////////////////
+	/// get the offset of the record a replayed form comes from
+	///
+	/// \param form : a form enqueued by replay(), given by SendFormBatch::formNotSent()
+	///
+	/// \return the offset to give to requeue(), or -1 if the form doesn't come from an outbox
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 recordOffset( const SendForm & form );
+	
+	////////////////////////////////////////////////////////////
+	/// get the description of the last error
+	///
+	////////////////////////////////////////////////////////////
+	const QString & errorString() const;
+
+private:
+	QString m_path;
+	QString m_errorString;
+	
+	void recover();
+	bool write( const QByteArray & record );
+	bool serialize( const SendForm & form, bool inlineFiles, QByteArray & payload );
+	static bool enqueue( const QByteArray & payload, qint64 offset, SendFormBatch * batch );
+	static qint64 nextRecord( const uchar * data, qint64 size, qint64 offset, qint64 & payloadOffset, qint64 & payloadSize );
+};
+
+#endif
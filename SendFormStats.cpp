@@ -0,0 +1,280 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "SendFormStats.h"
+#include "MultipartBodyDevice.h"
+#include "ReadAheadDevice.h"
+
+#include <QMutexLocker>
+
+////////////////////////////////////////////////////////////
+/// get the statistics of a reply
+////////////////////////////////////////////////////////////
+SendFormStats * SendFormStats::forReply( QNetworkReply * reply )
+{
+	return reply ? reply->findChild< SendFormStats * >() : 0;
+}
+
+qint64 SendFormStats::encodingTime() const
+{
+	return m_encodingTime;
+}
+
+qint64 SendFormStats::fileReadTime() const
+{
+	// the body is still alive until the reply is destroyed
+	if( m_body ) return m_body->fileReadTime() / 1000;
+	if( m_readAhead ) return m_readAhead->sourceReadTime() / 1000;
+	
+	return m_fileReadTime;
+}
+
+QList< QPair< QString, qint64 > > SendFormStats::partSizes() const
+{
+	return m_partSizes;
+}
+
+qint64 SendFormStats::totalBytes() const
+{
+	return m_totalBytes;
+}
+
+qint64 SendFormStats::timeToFirstUploadByte() const
+{
+	return m_firstUploadByte;
+}
+
+qint64 SendFormStats::uploadDuration() const
+{
+	if( m_firstUploadByte < 0 || m_lastUploadByte < 0 ) return -1;
+	
+	return m_lastUploadByte - m_firstUploadByte;
+}
+
+qint64 SendFormStats::timeToFirstResponseByte() const
+{
+	return m_firstResponseByte;
+}
+
+qint64 SendFormStats::totalTime() const
+{
+	return m_finished;
+}
+
+void SendFormStats::uploadProgress( qint64 bytesSent, qint64 bytesTotal )
+{
+	if( bytesSent > 0 && m_firstUploadByte < 0 )
+	{
+		m_firstUploadByte = now();
+	}
+	
+	if( bytesTotal > 0 && bytesSent == bytesTotal && m_lastUploadByte < 0 )
+	{
+		m_lastUploadByte = now();
+		m_totalBytes = bytesTotal;
+	}
+}
+
+void SendFormStats::metaDataChanged()
+{
+	if( m_firstResponseByte < 0 ) m_firstResponseByte = now();
+}
+
+void SendFormStats::replyFinished()
+{
+	m_finished = now();
+	
+	m_fileReadTime = fileReadTime();
+	
+	if( m_collector ) m_collector->record( *this );
+}
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+SendFormStats::SendFormStats()
+{
+	m_collector = 0;
+	m_encodingTime = -1;
+	m_fileReadTime = 0;
+	m_totalBytes = -1;
+	m_firstUploadByte = -1;
+	m_lastUploadByte = -1;
+	m_firstResponseByte = -1;
+	m_finished = -1;
+}
+
+////////////////////////////////////////////////////////////
+/// called at the beginning of post()
+////////////////////////////////////////////////////////////
+void SendFormStats::start()
+{
+	m_timer.start();
+}
+
+////////////////////////////////////////////////////////////
+/// follow the reply once it has been created
+////////////////////////////////////////////////////////////
+void SendFormStats::attach( QNetworkReply * reply, MultipartBodyDevice * body, SendFormStatsCollector * collector )
+{
+	setParent( reply );
+	m_body = body;
+	m_collector = collector;
+	
+	connect( reply, SIGNAL( uploadProgress( qint64, qint64 ) ), this, SLOT( uploadProgress( qint64, qint64 ) ) );
+	connect( reply, SIGNAL( metaDataChanged() ), this, SLOT( metaDataChanged() ) );
+	connect( reply, SIGNAL( finished() ), this, SLOT( replyFinished() ) );
+}
+
+qint64 SendFormStats::now() const
+{
+	return m_timer.nsecsElapsed() / 1000;
+}
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+SendFormStatsCollector::SendFormStatsCollector()
+{
+	reset();
+}
+
+////////////////////////////////////////////////////////////
+/// add the statistics of a finished request
+////////////////////////////////////////////////////////////
+void SendFormStatsCollector::record( const SendFormStats & stats )
+{
+	QMutexLocker locker( &m_mutex );
+	
+	m_count++;
+	add( EncodingTime, stats.encodingTime() );
+	add( FileReadTime, stats.fileReadTime() );
+	add( TimeToFirstUploadByte, stats.timeToFirstUploadByte() );
+	add( UploadDuration, stats.uploadDuration() );
+	add( TimeToFirstResponseByte, stats.timeToFirstResponseByte() );
+	add( TotalTime, stats.totalTime() );
+	add( TotalBytes, stats.totalBytes() );
+	
+	QList< QPair< QString, qint64 > > parts = stats.partSizes();
+	for(int i = 0;i < parts.count();i++)
+	{
+		add( PartBytes, parts[i].second );
+	}
+}
+
+qint64 SendFormStatsCollector::count() const
+{
+	QMutexLocker locker( &m_mutex );
+	return m_count;
+}
+
+QVector< qint64 > SendFormStatsCollector::histogram( Metric metric ) const
+{
+	QMutexLocker locker( &m_mutex );
+	
+	QVector< qint64 > buckets( BucketCount );
+	for(int i = 0;i < BucketCount;i++)
+	{
+		buckets[i] = m_buckets[metric][i];
+	}
+	
+	return buckets;
+}
+
+qint64 SendFormStatsCollector::sum( Metric metric ) const
+{
+	QMutexLocker locker( &m_mutex );
+	return m_sums[metric];
+}
+
+////////////////////////////////////////////////////////////
+/// export all the histograms in the Prometheus text format
+////////////////////////////////////////////////////////////
+QByteArray SendFormStatsCollector::toText() const
+{
+	static const char * const names[MetricCount] =
+	{
+		"sendform_encoding_time_microseconds",
+		"sendform_file_read_time_microseconds",
+		"sendform_time_to_first_upload_byte_microseconds",
+		"sendform_upload_duration_microseconds",
+		"sendform_time_to_first_response_byte_microseconds",
+		"sendform_total_time_microseconds",
+		"sendform_body_bytes",
+		"sendform_part_bytes"
+	};
+	
+	QMutexLocker locker( &m_mutex );
+	
+	QByteArray text;
+	for(int metric = 0;metric < MetricCount;metric++)
+	{
+		QByteArray name = names[metric];
+		text += "# TYPE " + name + " histogram\n";
+		
+		qint64 cumulated = 0;
+		for(int i = 0;i < BucketCount;i++)
+		{
+			cumulated += m_buckets[metric][i];
+			text += name + "_bucket{le=\"" + QByteArray::number( Q_INT64_C( 1 ) << i ) + "\"} " + QByteArray::number( cumulated ) + "\n";
+		}
+		
+		text += name + "_bucket{le=\"+Inf\"} " + QByteArray::number( m_values[metric] ) + "\n";
+		text += name + "_sum " + QByteArray::number( m_sums[metric] ) + "\n";
+		text += name + "_count " + QByteArray::number( m_values[metric] ) + "\n";
+	}
+	
+	return text;
+}
+
+////////////////////////////////////////////////////////////
+/// forget everything that has been recorded
+////////////////////////////////////////////////////////////
+void SendFormStatsCollector::reset()
+{
+	QMutexLocker locker( &m_mutex );
+	
+	m_count = 0;
+	for(int metric = 0;metric < MetricCount;metric++)
+	{
+		m_values[metric] = 0;
+		m_sums[metric] = 0;
+		for(int i = 0;i < BucketCount;i++)
+		{
+			m_buckets[metric][i] = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// add a value to a histogram, the values that are unknown are ignored
+////////////////////////////////////////////////////////////
+void SendFormStatsCollector::add( Metric metric, qint64 value )
+{
+	if( value < 0 ) return;
+	
+	// values bigger than the last bucket only appear in "+Inf"
+	int bucket = 0;
+	while( bucket < BucketCount && ( Q_INT64_C( 1 ) << bucket ) < value )
+	{
+		bucket++;
+	}
+	
+	if( bucket < BucketCount ) m_buckets[metric][bucket]++;
+	m_values[metric]++;
+	m_sums[metric] += value;
+}
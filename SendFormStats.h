@@ -0,0 +1,218 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_STATS_WITH_QT
+#define SEND_FORM_STATS_WITH_QT
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QNetworkReply>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QString>
+#include <QVector>
+
+class MultipartBodyDevice;
+class ReadAheadDevice;
+class SendFormStatsCollector;
+
+////////////////////////////////////////////////////////////
+/// SendFormStats measures where the time of a request goes.
+///
+/// It is created by SendForm::post() when statistics are enabled, and lives as long as the reply.
+/// All the durations are in microseconds, -1 when the event hasn't happened (yet).
+////////////////////////////////////////////////////////////
+class SendFormStats : public QObject
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// get the statistics of a reply
+	///
+	/// \param reply : a reply returned by SendForm::post()
+	///
+	/// \return the statistics, or 0 if they weren't enabled for this form
+	///
+	////////////////////////////////////////////////////////////
+	static SendFormStats * forReply( QNetworkReply * reply );
+	
+	////////////////////////////////////////////////////////////
+	/// get the time spent to create the body in post()
+	///
+	////////////////////////////////////////////////////////////
+	qint64 encodingTime() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the time spent opening and reading the files while the body was sent
+	///
+	////////////////////////////////////////////////////////////
+	qint64 fileReadTime() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the size of each part of a multipart body (name of the field, size with its headers), -1 for a device of unknown size
+	///
+	////////////////////////////////////////////////////////////
+	QList< QPair< QString, qint64 > > partSizes() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body sent (before compression until the upload has started)
+	///
+	////////////////////////////////////////////////////////////
+	qint64 totalBytes() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the time between post() and the first byte of body sent
+	///
+	////////////////////////////////////////////////////////////
+	qint64 timeToFirstUploadByte() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the time between the first and the last byte of body sent
+	///
+	////////////////////////////////////////////////////////////
+	qint64 uploadDuration() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the time between post() and the headers of the response
+	///
+	////////////////////////////////////////////////////////////
+	qint64 timeToFirstResponseByte() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the time between post() and the end of the reply
+	///
+	////////////////////////////////////////////////////////////
+	qint64 totalTime() const;
+
+private slots:
+	void uploadProgress( qint64 bytesSent, qint64 bytesTotal );
+	void metaDataChanged();
+	void replyFinished();
+
+private:
+	friend class SendForm;
+	friend class SendFormAsyncPost;
+	
+	SendFormStats();
+	void start();
+	void attach( QNetworkReply * reply, MultipartBodyDevice * body, SendFormStatsCollector * collector );
+	qint64 now() const;
+	
+	QElapsedTimer m_timer;
+	QPointer< MultipartBodyDevice > m_body;
+	QPointer< ReadAheadDevice > m_readAhead;
+	SendFormStatsCollector * m_collector;
+	
+	qint64 m_encodingTime;
+	qint64 m_fileReadTime;
+	QList< QPair< QString, qint64 > > m_partSizes;
+	qint64 m_totalBytes;
+	qint64 m_firstUploadByte;
+	qint64 m_lastUploadByte;
+	qint64 m_firstResponseByte;
+	qint64 m_finished;
+};
+
+////////////////////////////////////////////////////////////
+/// SendFormStatsCollector aggregates the statistics of many requests in histograms.
+///
+/// It can be shared by several forms and threads, and exported in the Prometheus text format.
+////////////////////////////////////////////////////////////
+class SendFormStatsCollector
+{
+public:
+	enum Metric
+	{
+		EncodingTime,				///< SendFormStats::encodingTime(), in microseconds
+		FileReadTime,				///< SendFormStats::fileReadTime(), in microseconds
+		TimeToFirstUploadByte,		///< SendFormStats::timeToFirstUploadByte(), in microseconds
+		UploadDuration,				///< SendFormStats::uploadDuration(), in microseconds
+		TimeToFirstResponseByte,	///< SendFormStats::timeToFirstResponseByte(), in microseconds
+		TotalTime,					///< SendFormStats::totalTime(), in microseconds
+		TotalBytes,					///< SendFormStats::totalBytes(), in bytes
+		PartBytes,					///< each value of SendFormStats::partSizes(), in bytes
+		MetricCount
+	};
+	
+	// bucket i counts the values lower or equal to 2^i
+	enum { BucketCount = 40 };
+	
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	////////////////////////////////////////////////////////////
+	SendFormStatsCollector();
+	
+	////////////////////////////////////////////////////////////
+	/// add the statistics of a finished request
+	///
+	/// \param stats : the statistics
+	///
+	/// \remarks called automatically for the forms using this collector
+	///
+	////////////////////////////////////////////////////////////
+	void record( const SendFormStats & stats );
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of requests recorded
+	///
+	////////////////////////////////////////////////////////////
+	qint64 count() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of values recorded in each bucket of a metric (not cumulative)
+	///
+	/// \param metric : the metric
+	///
+	////////////////////////////////////////////////////////////
+	QVector< qint64 > histogram( Metric metric ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the sum of the values recorded for a metric
+	///
+	/// \param metric : the metric
+	///
+	////////////////////////////////////////////////////////////
+	qint64 sum( Metric metric ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// export all the histograms in the Prometheus text format
+	///
+	////////////////////////////////////////////////////////////
+	QByteArray toText() const;
+	
+	////////////////////////////////////////////////////////////
+	/// forget everything that has been recorded
+	///
+	////////////////////////////////////////////////////////////
+	void reset();
+
+private:
+	mutable QMutex m_mutex;
+	qint64 m_count;
+	qint64 m_values[MetricCount];
+	qint64 m_sums[MetricCount];
+	qint64 m_buckets[MetricCount][BucketCount];
+	
+	void add( Metric metric, qint64 value );
+};
+
+#endif
@@ -0,0 +1,94 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "ThrottledBodyDevice.h"
+#include "UploadScheduler.h"
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+ThrottledBodyDevice::ThrottledBodyDevice( QIODevice * source, UploadScheduler * scheduler, const QString & host, int weight, QObject * parent ) : QIODevice( parent )
+{
+	m_source = source;
+	m_source->setParent( this );
+	m_scheduler = scheduler;
+	m_scheduler->addUpload( this, host, weight );
+	
+	connect( source, SIGNAL( readyRead() ), this, SIGNAL( readyRead() ) );
+}
+
+////////////////////////////////////////////////////////////
+/// Destructor
+////////////////////////////////////////////////////////////
+ThrottledBodyDevice::~ThrottledBodyDevice()
+{
+	if( m_scheduler ) m_scheduler->removeUpload( this );
+}
+
+bool ThrottledBodyDevice::open( OpenMode mode )
+{
+	if( mode & QIODevice::WriteOnly ) return false;
+	
+	return QIODevice::open( mode | QIODevice::Unbuffered );
+}
+
+bool ThrottledBodyDevice::isSequential() const
+{
+	return true;
+}
+
+qint64 ThrottledBodyDevice::size() const
+{
+	return m_source->size();
+}
+
+bool ThrottledBodyDevice::atEnd() const
+{
+	return m_source->atEnd();
+}
+
+////////////////////////////////////////////////////////////
+/// read no more than the tokens given, what isn't read goes back to the scheduler
+////////////////////////////////////////////////////////////
+qint64 ThrottledBodyDevice::readData( char * data, qint64 maxSize )
+{
+	// the scheduler is gone, nothing limits the body anymore
+	qint64 allowed = m_scheduler ? m_scheduler->acquire( this, maxSize ) : maxSize;
+	if( allowed == 0 ) return 0;
+	
+	qint64 read = m_source->read( data, allowed );
+	
+	if( m_scheduler && read < allowed ) m_scheduler->giveBack( this, allowed - qMax( read, qint64( 0 ) ) );
+	
+	// the source may be random-access, the end of a sequential device is -1
+	if( read == 0 && m_source->atEnd() ) return -1;
+	
+	return read;
+}
+
+qint64 ThrottledBodyDevice::writeData( const char *, qint64 )
+{
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+/// tokens were given while the body was waiting
+////////////////////////////////////////////////////////////
+void ThrottledBodyDevice::wake()
+{
+	emit readyRead();
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_THROTTLED_BODY_DEVICE
+#define SEND_FORM_THROTTLED_BODY_DEVICE
+
+#include <QIODevice>
+#include <QPointer>
+#include <QString>
+
+class UploadScheduler;
+
+////////////////////////////////////////////////////////////
+/// ThrottledBodyDevice gives another device only as fast as an UploadScheduler allows.
+///
+/// When there is no token, nothing is read and readyRead() is emitted once the scheduler
+/// has given some.
+////////////////////////////////////////////////////////////
+class ThrottledBodyDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param source : the opened body, it becomes a child of the device
+	/// \param scheduler : the scheduler giving the tokens
+	/// \param host : the host the body is sent to
+	/// \param weight : the share of the tokens this body gets compared to the others (at least 1)
+	/// \param parent : the parent of the device
+	///
+	////////////////////////////////////////////////////////////
+	ThrottledBodyDevice( QIODevice * source, UploadScheduler * scheduler, const QString & host, int weight, QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// Destructor
+	///
+	////////////////////////////////////////////////////////////
+	~ThrottledBodyDevice();
+	
+	bool open( OpenMode mode );
+	bool isSequential() const;
+	qint64 size() const;
+	bool atEnd() const;
+
+protected:
+	qint64 readData( char * data, qint64 maxSize );
+	qint64 writeData( const char * data, qint64 maxSize );
+
+private:
+	friend class UploadScheduler;
+	
+	void wake();
+	
+	QIODevice * m_source;
+	QPointer< UploadScheduler > m_scheduler;
+};
+
+#endif
@@ -0,0 +1,321 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "UploadScheduler.h"
+#include "ThrottledBodyDevice.h"
+
+#include <QList>
+
+namespace
+{
+	// tokens are given every tick, and pile up for a burst at most
+	const int RefillInterval = 10;
+	const qint64 BurstDivisor = 10;
+	const qint64 MinimumBurst = 4096;
+	const qint64 NanosecondsPerSecond = Q_INT64_C( 1000000000 );
+	
+	// a longer time fills any bucket, and rate * elapsed can't overflow
+	const qint64 MaximumElapsed = NanosecondsPerSecond;
+	
+	qint64 burst( qint64 rate )
+	{
+		// a rate below the minimum burst isn't allowed more than one second of tokens at once
+		return qMax( rate / BurstDivisor, qMin( rate, MinimumBurst ) );
+	}
+	
+	void fill( qint64 & tokens, qint64 & remainder, qint64 rate, qint64 elapsed )
+	{
+		if( rate <= 0 ) return;
+		
+		// the fraction of a token earned is carried to the next tick, a tick being 10 ms
+		// a rate below 100 bytes/s would never get a token otherwise, and any rate would lose up to 100 bytes/s
+		qint64 earned = rate * elapsed + remainder;
+		tokens += earned / NanosecondsPerSecond;
+		remainder = earned % NanosecondsPerSecond;
+		
+		if( tokens >= burst( rate ) )
+		{
+			tokens = burst( rate );
+			remainder = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// Constructor
+////////////////////////////////////////////////////////////
+UploadScheduler::UploadScheduler( QObject * parent ) : QObject( parent )
+{
+	m_bytesSent = 0;
+	m_lastRefill = 0;
+	
+	m_timer.setInterval( RefillInterval );
+	connect( &m_timer, SIGNAL( timeout() ), this, SLOT( refill() ) );
+	m_clock.start();
+}
+
+////////////////////////////////////////////////////////////
+/// Destructor
+////////////////////////////////////////////////////////////
+UploadScheduler::~UploadScheduler()
+{
+	// the devices hold a guarded pointer, wake the waiting ones so they read without limit
+	QList< ThrottledBodyDevice * > waiting;
+	
+	for( QHash< ThrottledBodyDevice *, Upload >::const_iterator it = m_uploads.constBegin();it != m_uploads.constEnd();++it )
+	{
+		if( it.value().waiting ) waiting.append( it.key() );
+	}
+	
+	m_uploads.clear();
+	
+	for(int i = 0;i < waiting.size();i++)
+	{
+		QMetaObject::invokeMethod( waiting[i], "readyRead", Qt::QueuedConnection );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// set the rate of all the uploads together
+////////////////////////////////////////////////////////////
+void UploadScheduler::setGlobalRate( qint64 bytesPerSecond )
+{
+	m_global.rate = qMax( bytesPerSecond, qint64( 0 ) );
+	m_global.tokens = qMin( m_global.tokens, burst( m_global.rate ) );
+	
+	// uploads that didn't have a limit anymore must be woken up
+	if( !m_timer.isActive() && waitingUploads() > 0 ) m_timer.start();
+}
+
+qint64 UploadScheduler::globalRate() const
+{
+	return m_global.rate;
+}
+
+////////////////////////////////////////////////////////////
+/// set the rate of the uploads to a host
+////////////////////////////////////////////////////////////
+void UploadScheduler::setHostRate( const QString & host, qint64 bytesPerSecond )
+{
+	if( bytesPerSecond <= 0 )
+	{
+		m_hosts.remove( host );
+	}
+	else
+	{
+		Bucket & bucket = m_hosts[host];
+		bucket.rate = bytesPerSecond;
+		bucket.tokens = qMin( bucket.tokens, burst( bucket.rate ) );
+	}
+	
+	if( !m_timer.isActive() && waitingUploads() > 0 ) m_timer.start();
+}
+
+qint64 UploadScheduler::hostRate( const QString & host ) const
+{
+	return m_hosts.value( host ).rate;
+}
+
+////////////////////////////////////////////////////////////
+/// get the number of bytes of body given to the network layer
+////////////////////////////////////////////////////////////
+qint64 UploadScheduler::bytesSent() const
+{
+	return m_bytesSent;
+}
+
+qint64 UploadScheduler::bytesSent( const QString & host ) const
+{
+	return m_hostBytes.value( host );
+}
+
+////////////////////////////////////////////////////////////
+/// get the number of bodies being sent
+////////////////////////////////////////////////////////////
+int UploadScheduler::activeUploads() const
+{
+	return m_uploads.size();
+}
+
+////////////////////////////////////////////////////////////
+/// get the number of bodies waiting for tokens right now
+////////////////////////////////////////////////////////////
+int UploadScheduler::waitingUploads() const
+{
+	int count = 0;
+	
+	for( QHash< ThrottledBodyDevice *, Upload >::const_iterator it = m_uploads.constBegin();it != m_uploads.constEnd();++it )
+	{
+		if( it.value().waiting ) count++;
+	}
+	
+	return count;
+}
+
+void UploadScheduler::addUpload( ThrottledBodyDevice * device, const QString & host, int weight )
+{
+	Upload upload;
+	upload.host = host;
+	upload.weight = qMax( weight, 1 );
+	upload.allowance = 0;
+	upload.waiting = false;
+	
+	m_uploads.insert( device, upload );
+}
+
+void UploadScheduler::removeUpload( ThrottledBodyDevice * device )
+{
+	m_uploads.remove( device );
+	
+	if( m_uploads.isEmpty() ) m_timer.stop();
+}
+
+bool UploadScheduler::limited( const QString & host ) const
+{
+	return m_global.rate > 0 || m_hosts.contains( host );
+}
+
+////////////////////////////////////////////////////////////
+/// take up to maxSize bytes from the allowance of an upload, 0 makes it wait for the next refill
+////////////////////////////////////////////////////////////
+qint64 UploadScheduler::acquire( ThrottledBodyDevice * device, qint64 maxSize )
+{
+	QHash< ThrottledBodyDevice *, Upload >::iterator it = m_uploads.find( device );
+	if( it == m_uploads.end() ) return maxSize;
+	
+	Upload & upload = it.value();
+	qint64 granted = maxSize;
+	
+	if( limited( upload.host ) )
+	{
+		granted = qMin( maxSize, upload.allowance );
+		upload.allowance -= granted;
+	}
+	
+	if( granted == 0 )
+	{
+		upload.waiting = true;
+		if( !m_timer.isActive() ) m_timer.start();
+		
+		return 0;
+	}
+	
+	upload.waiting = false;
+	m_bytesSent += granted;
+	m_hostBytes[upload.host] += granted;
+	
+	return granted;
+}
+
+////////////////////////////////////////////////////////////
+/// the source had less than what was granted
+////////////////////////////////////////////////////////////
+void UploadScheduler::giveBack( ThrottledBodyDevice * device, qint64 bytes )
+{
+	QHash< ThrottledBodyDevice *, Upload >::iterator it = m_uploads.find( device );
+	if( it == m_uploads.end() ) return;
+	
+	Upload & upload = it.value();
+	if( limited( upload.host ) ) upload.allowance += bytes;
+	
+	m_bytesSent -= bytes;
+	m_hostBytes[upload.host] -= bytes;
+}
+
+////////////////////////////////////////////////////////////
+/// add the tokens earned since the last tick, and share them between the waiting uploads by weight
+////////////////////////////////////////////////////////////
+void UploadScheduler::refill()
+{
+	qint64 now = m_clock.nsecsElapsed();
+	qint64 elapsed = qMin( now - m_lastRefill, MaximumElapsed );
+	m_lastRefill = now;
+	
+	fill( m_global.tokens, m_global.remainder, m_global.rate, elapsed );
+	
+	for( QHash< QString, Bucket >::iterator it = m_hosts.begin();it != m_hosts.end();++it )
+	{
+		fill( it.value().tokens, it.value().remainder, it.value().rate, elapsed );
+	}
+	
+	// the total weight of the waiting uploads, for all of them and for each limited host
+	qint64 totalWeight = 0;
+	QHash< QString, qint64 > hostWeights;
+	
+	for( QHash< ThrottledBodyDevice *, Upload >::const_iterator it = m_uploads.constBegin();it != m_uploads.constEnd();++it )
+	{
+		if( !it.value().waiting ) continue;
+		
+		totalWeight += it.value().weight;
+		if( m_hosts.contains( it.value().host ) ) hostWeights[it.value().host] += it.value().weight;
+	}
+	
+	if( totalWeight == 0 )
+	{
+		m_timer.stop();
+		return;
+	}
+	
+	qint64 globalTokens = m_global.tokens;
+	QHash< QString, qint64 > hostTokens;
+	
+	for( QHash< QString, Bucket >::const_iterator it = m_hosts.constBegin();it != m_hosts.constEnd();++it )
+	{
+		hostTokens.insert( it.key(), it.value().tokens );
+	}
+	
+	QList< ThrottledBodyDevice * > woken;
+	
+	for( QHash< ThrottledBodyDevice *, Upload >::iterator it = m_uploads.begin();it != m_uploads.end();++it )
+	{
+		Upload & upload = it.value();
+		if( !upload.waiting ) continue;
+		
+		qint64 share = -1;
+		
+		if( m_global.rate > 0 ) share = globalTokens * upload.weight / totalWeight;
+		
+		if( m_hosts.contains( upload.host ) )
+		{
+			qint64 hostShare = hostTokens.value( upload.host ) * upload.weight / hostWeights.value( upload.host );
+			share = share < 0 ? hostShare : qMin( share, hostShare );
+		}
+		
+		// no limit applies anymore, the next read takes what it needs
+		if( share < 0 )
+		{
+			upload.waiting = false;
+			woken.append( it.key() );
+			continue;
+		}
+		
+		if( share == 0 ) continue;
+		
+		upload.allowance += share;
+		upload.waiting = false;
+		m_global.tokens -= m_global.rate > 0 ? share : 0;
+		if( m_hosts.contains( upload.host ) ) m_hosts[upload.host].tokens -= share;
+		
+		woken.append( it.key() );
+	}
+	
+	// the devices may be read right away, the upload table must not change under the loop
+	for(int i = 0;i < woken.size();i++)
+	{
+		woken[i]->wake();
+	}
+}
@@ -0,0 +1,144 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_UPLOAD_SCHEDULER_WITH_QT
+#define SEND_FORM_UPLOAD_SCHEDULER_WITH_QT
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+class ThrottledBodyDevice;
+
+////////////////////////////////////////////////////////////
+/// UploadScheduler limits the rate at which the bodies of the forms are sent.
+///
+/// The rates are token buckets: one for all the uploads, and one for each host that has a rate.
+/// When the tokens are scarce, they are shared between the uploads waiting for them in
+/// proportion to their weight.
+///
+/// The forms using a scheduler must be posted from its thread (see SendForm::setUploadScheduler).
+////////////////////////////////////////////////////////////
+class UploadScheduler : public QObject
+{
+	Q_OBJECT
+	
+public:
+	////////////////////////////////////////////////////////////
+	/// Constructor
+	///
+	/// \param parent : the parent of the scheduler
+	///
+	////////////////////////////////////////////////////////////
+	UploadScheduler( QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// Destructor
+	///
+	/// \remarks the uploads still running aren't limited anymore
+	///
+	////////////////////////////////////////////////////////////
+	~UploadScheduler();
+	
+	////////////////////////////////////////////////////////////
+	/// set the rate of all the uploads together
+	///
+	/// \param bytesPerSecond : the rate, 0 for no limit (the default)
+	///
+	////////////////////////////////////////////////////////////
+	void setGlobalRate( qint64 bytesPerSecond );
+	
+	qint64 globalRate() const;
+	
+	////////////////////////////////////////////////////////////
+	/// set the rate of the uploads to a host
+	///
+	/// \param host : the host of the destination of the forms
+	/// \param bytesPerSecond : the rate, 0 for no limit (the default)
+	///
+	////////////////////////////////////////////////////////////
+	void setHostRate( const QString & host, qint64 bytesPerSecond );
+	
+	qint64 hostRate( const QString & host ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body given to the network layer
+	///
+	////////////////////////////////////////////////////////////
+	qint64 bytesSent() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body given to the network layer for a host
+	///
+	////////////////////////////////////////////////////////////
+	qint64 bytesSent( const QString & host ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bodies being sent
+	///
+	////////////////////////////////////////////////////////////
+	int activeUploads() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bodies waiting for tokens right now
+	///
+	////////////////////////////////////////////////////////////
+	int waitingUploads() const;
+
+private slots:
+	void refill();
+
+private:
+	friend class ThrottledBodyDevice;
+	
+	struct Bucket
+	{
+		Bucket() : rate( 0 ), tokens( 0 ), remainder( 0 ) {}
+		
+		qint64 rate;
+		qint64 tokens;
+		qint64 remainder;	///< fraction of a token earned, in byte-nanoseconds
+	};
+	
+	struct Upload
+	{
+		QString host;
+		int weight;
+		qint64 allowance;
+		bool waiting;
+	};
+	
+	void addUpload( ThrottledBodyDevice * device, const QString & host, int weight );
+	void removeUpload( ThrottledBodyDevice * device );
+	qint64 acquire( ThrottledBodyDevice * device, qint64 maxSize );
+	void giveBack( ThrottledBodyDevice * device, qint64 bytes );
+	bool limited( const QString & host ) const;
+	
+	Bucket m_global;
+	QHash< QString, Bucket > m_hosts;
+	QHash< QString, qint64 > m_hostBytes;
+	QHash< ThrottledBodyDevice *, Upload > m_uploads;
+	qint64 m_bytesSent;
+	
+	QTimer m_timer;
+	QElapsedTimer m_clock;
+	qint64 m_lastRefill;
+};
+
+#endif
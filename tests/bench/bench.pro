@@ -0,0 +1,8 @@
+TARGET = tst_bench
+include(../tests.pri)
+
+SOURCES += tst_bench.cpp \
+	../shared/BenchmarkMeasure.cpp
+HEADERS += ../shared/BenchmarkMeasure.h
+
+win32: LIBS += -lpsapi
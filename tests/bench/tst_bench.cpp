@@ -0,0 +1,633 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "BenchmarkMeasure.h"
+#include "H2Sink.h"
+#include "HttpSink.h"
+#include "SendForm.h"
+#include "SendFormBatch.h"
+#include "SendFormOutbox.h"
+#include "SendFormStats.h"
+#include "SendFormTest.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTemporaryDir>
+#include <QVector>
+#include <QtTest>
+#include <algorithm>
+#include <cstdio>
+
+////////////////////////////////////////////////////////////
+/// benchmarks of the encoding of the bodies and of whole posts
+////////////////////////////////////////////////////////////
+class tst_Bench : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	
+	void urlEncoded_data();
+	void urlEncoded();
+	void urlEncodedConcatenation_data();
+	void urlEncodedConcatenation();
+	
+	void multipart_data();
+	void multipart();
+	
+	void fileParts_data();
+	void fileParts();
+	
+	void mimeType();
+	void boundary();
+	
+	void roundTrip_data();
+	void roundTrip();
+	
+	void batch_data();
+	void batch();
+	
+	void outboxAppend();
+	void outboxReplay();
+	
+	void http2_data();
+	void http2();
+	
+	void prepare_data();
+	void prepare();
+
+private:
+	QTemporaryDir m_dir;
+	QString m_smallFile;
+	QString m_mediumFile;
+	QString m_largeFile;
+	qint64 m_largeSize;
+	
+	static SendForm fieldForm( const QUrl & url, int fields );
+	static qint64 readBody( SendForm & form );
+	static qint64 readAllBody( const QString & path );
+	static qint64 percentile( QVector< qint64 > values, int percent );
+};
+
+void tst_Bench::initTestCase()
+{
+	QVERIFY( m_dir.isValid() );
+	
+	// a small text file, like the ones attached to most forms
+	m_smallFile = m_dir.path() + "/small.txt";
+	QFile small( m_smallFile );
+	QVERIFY( small.open( QIODevice::WriteOnly ) );
+	for(int i = 0;i < 1024;i++)
+	{
+		small.write( QByteArray::number( i ).rightJustified( 63, '.' ) + "\n" );
+	}
+	small.close();
+	
+	// a file read entirely in memory by the old post()
+	m_mediumFile = m_dir.path() + "/medium.csv";
+	QFile medium( m_mediumFile );
+	QVERIFY( medium.open( QIODevice::WriteOnly ) );
+	QByteArray block;
+	for(int i = 0;i < 16 * 1024;i++)
+	{
+		block += QByteArray::number( i ).rightJustified( 63, ',' ) + "\n";
+	}
+	for(int i = 0;i < 64;i++)
+	{
+		medium.write( block );
+	}
+	medium.close();
+	
+	// a sparse file, so it takes neither the time nor the disk space to write it
+	m_largeSize = qgetenv( "SENDFORM_BENCH_LARGE_MB" ).isEmpty() ? 2048 : qgetenv( "SENDFORM_BENCH_LARGE_MB" ).toLongLong();
+	m_largeSize *= 1024 * 1024;
+	
+	if( m_largeSize > 0 )
+	{
+		m_largeFile = m_dir.path() + "/large.bin";
+		QFile large( m_largeFile );
+		QVERIFY( large.open( QIODevice::WriteOnly ) );
+		if( !large.resize( m_largeSize ) ) m_largeFile.clear();
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// a form of fields with names, spaces, reserved and non-ASCII characters to encode
+////////////////////////////////////////////////////////////
+SendForm tst_Bench::fieldForm( const QUrl & url, int fields )
+{
+	SendForm form( url );
+	form.reserveFields( fields, fields * 40 );
+	
+	for(int i = 0;i < fields;i++)
+	{
+		form.addField( QString( "field%1" ).arg( i ), QString::fromUtf8( "value %1 & more=été/ok" ).arg( i ) );
+	}
+	
+	return form;
+}
+
+qint64 tst_Bench::readBody( SendForm & form )
+{
+	qint64 length;
+	QIODevice * body = SendFormTest::createBody( form, length );
+	if( !body ) return -1;
+	
+	QByteArray chunk( 256 * 1024, Qt::Uninitialized );
+	qint64 total = 0;
+	for(;;)
+	{
+		qint64 read = body->read( chunk.data(), chunk.size() );
+		if( read <= 0 ) break;
+		
+		total += read;
+	}
+	
+	delete body;
+	return total;
+}
+
+void tst_Bench::urlEncoded_data()
+{
+	QTest::addColumn< int >( "fields" );
+	
+	QTest::newRow( "10" ) << 10;
+	QTest::newRow( "1k" ) << 1000;
+	QTest::newRow( "100k" ) << 100000;
+}
+
+void tst_Bench::urlEncoded()
+{
+	QFETCH( int, fields );
+	
+	SendForm form = fieldForm( QUrl( "http://127.0.0.1/" ), fields );
+	
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		measure.add( SendFormTest::urlEncodedBody( form ).size() );
+	}
+	measure.report();
+}
+
+void tst_Bench::urlEncodedConcatenation_data()
+{
+	urlEncoded_data();
+}
+
+////////////////////////////////////////////////////////////
+/// the body built like SendForm did before FormEntries and FormUrlEncoder:
+/// one temporary array per field appended to the body, over a QHash.
+/// The old code didn't encode the fields at all, QUrl::toPercentEncoding is added to compare the same work.
+////////////////////////////////////////////////////////////
+void tst_Bench::urlEncodedConcatenation()
+{
+	QFETCH( int, fields );
+	
+	QHash< QString, QString > hash;
+	for(int i = 0;i < fields;i++)
+	{
+		hash.insert( QString( "field%1" ).arg( i ), QString::fromUtf8( "value %1 & more=été/ok" ).arg( i ) );
+	}
+	
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		QByteArray body;
+		
+		QHashIterator< QString, QString > i( hash );
+		while( i.hasNext() )
+		{
+			i.next();
+			
+			body += "&" + QUrl::toPercentEncoding( i.key() ) + "=" + QUrl::toPercentEncoding( i.value() );
+		}
+		
+		body.remove( 0, 1 );
+		measure.add( body.size() );
+	}
+	measure.report();
+}
+
+void tst_Bench::multipart_data()
+{
+	QTest::addColumn< bool >( "large" );
+	
+	QTest::newRow( "small" ) << false;
+	QTest::newRow( "large" ) << true;
+}
+
+void tst_Bench::multipart()
+{
+	QFETCH( bool, large );
+	
+	if( large && m_largeFile.isEmpty() ) QSKIP( "no large file (see SENDFORM_BENCH_LARGE_MB)" );
+	
+	SendForm form( QUrl( "http://127.0.0.1/" ) );
+	form.addFile( "file", large ? m_largeFile : m_smallFile );
+	form.addField( "description", "benchmark" );
+	
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		qint64 read = readBody( form );
+		QVERIFY( read > 0 );
+		measure.add( read );
+	}
+	measure.report();
+}
+
+////////////////////////////////////////////////////////////
+/// the body as the old post() built it, the file read with readAll() and concatenated twice
+////////////////////////////////////////////////////////////
+qint64 tst_Bench::readAllBody( const QString & path )
+{
+	QByteArray boundary = SendFormTest::generateBoundary();
+	QByteArray temp_data;
+	
+	QFile file( path );
+	if( !file.open( QIODevice::ReadOnly ) ) return -1;
+	
+	QFileInfo fi( file );
+	QByteArray aadata = "--" + boundary;
+	aadata += "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"" + fi.fileName().toUtf8() + "\";\r\n";
+	aadata += "Content-Type: text/plain\r\n\r\n" + file.readAll() + "\r\n";
+	temp_data += aadata;
+	temp_data += "--" + boundary + "--\r\n";
+	
+	return temp_data.size();
+}
+
+void tst_Bench::fileParts_data()
+{
+	QTest::addColumn< bool >( "medium" );
+	QTest::addColumn< bool >( "readAll" );
+	
+	QTest::newRow( "64 KiB mapped" ) << false << false;
+	QTest::newRow( "64 KiB readAll" ) << false << true;
+	QTest::newRow( "64 MiB mapped" ) << true << false;
+	QTest::newRow( "64 MiB readAll" ) << true << true;
+}
+
+////////////////////////////////////////////////////////////
+/// the file parts served from a mapping compared to the file read in memory
+////////////////////////////////////////////////////////////
+void tst_Bench::fileParts()
+{
+	QFETCH( bool, medium );
+	QFETCH( bool, readAll );
+	
+	QString path = medium ? m_mediumFile : m_smallFile;
+	
+	SendForm form( QUrl( "http://127.0.0.1/" ) );
+	form.addFile( "file", path );
+	
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		qint64 read = readAll ? readAllBody( path ) : readBody( form );
+		QVERIFY( read > 0 );
+		measure.add( read );
+	}
+	measure.report();
+}
+
+void tst_Bench::mimeType()
+{
+	QStringList suffixes;
+	suffixes << "txt" << "html" << "jpg" << "png" << "pdf" << "zip" << "mp3" << "json" << "csv" << "doc" << "unknown" << "c" << "tar" << "xml" << "gz" << "svg";
+	
+	int found = 0;
+	QBENCHMARK
+	{
+		for(int i = 0;i < suffixes.count();i++)
+		{
+			if( SendFormTest::mimeType( suffixes[i] ) ) found++;
+		}
+	}
+	QVERIFY( found > 0 );
+}
+
+void tst_Bench::boundary()
+{
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		measure.add( SendFormTest::generateBoundary().size() );
+	}
+	measure.report();
+}
+
+void tst_Bench::roundTrip_data()
+{
+	QTest::addColumn< bool >( "multipart" );
+	
+	QTest::newRow( "urlencoded" ) << false;
+	QTest::newRow( "multipart" ) << true;
+}
+
+////////////////////////////////////////////////////////////
+/// post a form to a server of the process and wait for its response
+////////////////////////////////////////////////////////////
+void tst_Bench::roundTrip()
+{
+	QFETCH( bool, multipart );
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	QNetworkAccessManager manager;
+	SendForm form = fieldForm( sink.url(), 100 );
+	if( multipart ) form.addFile( "file", m_smallFile );
+	
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		QNetworkReply * reply = form.post( &manager );
+		QVERIFY( reply );
+		QVERIFY( SendFormTest::waitForFinished( reply ) );
+		QCOMPARE( reply->error(), QNetworkReply::NoError );
+		
+		measure.add( reply->request().rawHeader( "Content-Length" ).toLongLong() );
+		delete reply;
+	}
+	measure.report();
+}
+
+void tst_Bench::batch_data()
+{
+	QTest::addColumn< int >( "concurrency" );
+	
+	QTest::newRow( "1" ) << 1;
+	QTest::newRow( "2" ) << 2;
+	QTest::newRow( "4" ) << 4;
+	QTest::newRow( "6" ) << 6;
+	QTest::newRow( "12" ) << 12;
+}
+
+////////////////////////////////////////////////////////////
+/// many small forms sent by a batch, the requests per second depending on the requests in flight
+////////////////////////////////////////////////////////////
+void tst_Bench::batch()
+{
+	QFETCH( int, concurrency );
+	
+	const int forms = 500;
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	QNetworkAccessManager manager;
+	SendFormBatch batch( &manager );
+	batch.setMaxConcurrentPerHost( concurrency );
+	
+	SendForm form = fieldForm( sink.url(), 10 );
+	
+	QBENCHMARK_ONCE
+	{
+		QEventLoop loop;
+		connect( &batch, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+		
+		for(int i = 0;i < forms;i++)
+		{
+			batch.enqueue( form );
+		}
+		
+		if( batch.pendingCount() ) loop.exec();
+	}
+	
+	QCOMPARE( batch.completedCount(), forms );
+	QCOMPARE( batch.failedCount(), 0 );
+	QCOMPARE( sink.completeCount(), forms );
+	
+	std::printf( "     %.0f requests/s, %.2f ms average latency, %lld ms maximum latency, %d connections\n",
+		batch.requestsPerSecond(), batch.averageLatency(), batch.maximumLatency(), sink.connectionCount() );
+	std::fflush( stdout );
+}
+
+////////////////////////////////////////////////////////////
+/// forms saved in an outbox, each one flushed to the disk
+////////////////////////////////////////////////////////////
+void tst_Bench::outboxAppend()
+{
+	SendFormOutbox outbox( m_dir.path() + "/append.outbox" );
+	SendForm form = fieldForm( QUrl( "http://127.0.0.1/" ), 10 );
+	
+	BenchmarkMeasure measure;
+	QBENCHMARK
+	{
+		QVERIFY( outbox.append( form ) );
+		measure.add( form.plannedSize() );
+	}
+	measure.report();
+	
+	QVERIFY( outbox.clear() );
+}
+
+////////////////////////////////////////////////////////////
+/// an outbox read, sent to a server of the process and emptied
+////////////////////////////////////////////////////////////
+void tst_Bench::outboxReplay()
+{
+	const int forms = 2000;
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	SendFormOutbox outbox( m_dir.path() + "/replay.outbox" );
+	SendForm form = fieldForm( sink.url(), 10 );
+	for(int i = 0;i < forms;i++)
+	{
+		QVERIFY( outbox.append( form ) );
+	}
+	qint64 size = QFileInfo( outbox.path() ).size();
+	
+	QNetworkAccessManager manager;
+	SendFormBatch batch( &manager );
+	
+	QElapsedTimer timer;
+	qint64 readTime = 0;
+	
+	QBENCHMARK_ONCE
+	{
+		QEventLoop loop;
+		connect( &batch, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+		
+		timer.start();
+		qint64 end = outbox.replay( &batch );
+		readTime = timer.elapsed();
+		
+		if( batch.pendingCount() ) loop.exec();
+		QVERIFY( outbox.clear( end ) );
+	}
+	
+	QCOMPARE( batch.completedCount(), forms );
+	QCOMPARE( batch.failedCount(), 0 );
+	QCOMPARE( sink.completeCount(), forms );
+	
+	std::printf( "     %d forms (%lld bytes) read and enqueued in %lld ms, %.0f forms/s sent\n",
+		forms, size, readTime, batch.requestsPerSecond() );
+	std::fflush( stdout );
+}
+
+////////////////////////////////////////////////////////////
+/// the value below which a percentage of the values are
+////////////////////////////////////////////////////////////
+qint64 tst_Bench::percentile( QVector< qint64 > values, int percent )
+{
+	if( values.isEmpty() ) return 0;
+	
+	std::sort( values.begin(), values.end() );
+	return values[ qMin( values.count() - 1, values.count() * percent / 100 ) ];
+}
+
+void tst_Bench::http2_data()
+{
+	QTest::addColumn< bool >( "h2c" );
+	QTest::addColumn< int >( "concurrency" );
+	
+	// as many requests in flight as QNetworkAccessManager opens connections, or as the server allows streams
+	QTest::newRow( "http/1.1" ) << false << 6;
+	QTest::newRow( "h2c" ) << true << 100;
+}
+
+////////////////////////////////////////////////////////////
+/// many small forms sent by a batch over HTTP/1.1 connections or multiplexed on one HTTP/2 connection
+////////////////////////////////////////////////////////////
+void tst_Bench::http2()
+{
+	QFETCH( bool, h2c );
+	QFETCH( int, concurrency );
+	
+#if QT_VERSION < 0x050B00
+	if( h2c ) QSKIP( "HTTP/2 without TLS needs Qt 5.11" );
+#endif
+	
+	const int forms = 500;
+	
+	HttpSink http1Sink;
+	H2Sink http2Sink;
+	QVERIFY( h2c ? http2Sink.listen() : http1Sink.listen() );
+	
+	QNetworkAccessManager manager;
+	SendFormBatch batch( &manager );
+	batch.setMaxConcurrentPerHost( concurrency );
+	
+	QVector< qint64 > latencies;
+	connect( &batch, &SendFormBatch::formFinished, [&latencies]( QNetworkReply * reply )
+	{
+		SendFormStats * stats = SendFormStats::forReply( reply );
+		if( stats ) latencies.append( stats->totalTime() );
+	} );
+	
+	SendForm form = fieldForm( h2c ? http2Sink.url() : http1Sink.url(), 10 );
+	form.setHttp2( h2c, h2c );
+	form.setStatsEnabled( true );
+	
+	QBENCHMARK_ONCE
+	{
+		QEventLoop loop;
+		connect( &batch, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+		
+		for(int i = 0;i < forms;i++)
+		{
+			batch.enqueue( form );
+		}
+		
+		if( batch.pendingCount() ) loop.exec();
+	}
+	
+	QCOMPARE( batch.completedCount(), forms );
+	QCOMPARE( batch.failedCount(), 0 );
+	QCOMPARE( h2c ? http2Sink.completeCount() : http1Sink.completeCount(), forms );
+	QCOMPARE( latencies.count(), forms );
+	
+	std::printf( "     %.0f requests/s, p50 %.2f ms, p99 %.2f ms, %d connections\n", batch.requestsPerSecond(),
+		percentile( latencies, 50 ) / 1000.0, percentile( latencies, 99 ) / 1000.0, h2c ? http2Sink.connectionCount() : http1Sink.connectionCount() );
+	std::fflush( stdout );
+}
+
+void tst_Bench::prepare_data()
+{
+	QTest::addColumn< bool >( "warm" );
+	
+	QTest::newRow( "cold" ) << false;
+	QTest::newRow( "warm" ) << true;
+}
+
+////////////////////////////////////////////////////////////
+/// the first post of a new QNetworkAccessManager, with or without a connection opened by SendForm::prepare()
+////////////////////////////////////////////////////////////
+void tst_Bench::prepare()
+{
+	QFETCH( bool, warm );
+	
+#if QT_VERSION < 0x050200
+	QSKIP( "SendForm::prepare() opens the connection with Qt 5.2 and later" );
+#endif
+	
+	const int samples = 100;
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	QVector< qint64 > latencies;
+	QElapsedTimer timer;
+	
+	QBENCHMARK_ONCE
+	{
+		for(int i = 0;i < samples;i++)
+		{
+			QNetworkAccessManager manager;
+			SendForm form = warm ? SendForm::prepare( &manager, sink.url() ) : SendForm( sink.url() );
+			
+			// the time the caller spends filling the form
+			if( warm && sink.connectionCount() <= i )
+			{
+				QSignalSpy accepted( &sink, SIGNAL( connectionAccepted() ) );
+				QVERIFY( accepted.wait( 1000 ) );
+			}
+			
+			form.addField( "sample", QString::number( i ) );
+			
+			timer.start();
+			QNetworkReply * reply = form.post( &manager );
+			QVERIFY( reply );
+			QVERIFY( SendFormTest::waitForFinished( reply ) );
+			latencies.append( timer.nsecsElapsed() / 1000 );
+			
+			QCOMPARE( reply->error(), QNetworkReply::NoError );
+			delete reply;
+		}
+	}
+	
+	// the prepared connection has been used by the post, not opened next to it
+	QCOMPARE( sink.connectionCount(), samples );
+	
+	std::printf( "     first post: p50 %.3f ms, p99 %.3f ms\n", percentile( latencies, 50 ) / 1000.0, percentile( latencies, 99 ) / 1000.0 );
+	std::fflush( stdout );
+}
+
+QTEST_MAIN( tst_Bench )
+
+#include "tst_bench.moc"
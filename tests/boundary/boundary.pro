@@ -0,0 +1,4 @@
+TARGET = tst_boundary
+include(../tests.pri)
+
+SOURCES += tst_boundary.cpp
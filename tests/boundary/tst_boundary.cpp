@@ -0,0 +1,163 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "SendForm.h"
+#include "SendFormTest.h"
+
+#include <QList>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSet>
+#include <QThreadPool>
+#include <QtTest>
+
+static const int threadCount = 8;
+static const int boundariesPerThread = 10000;
+
+////////////////////////////////////////////////////////////
+/// run by all the threads at the same time, once they have all started
+////////////////////////////////////////////////////////////
+class StressTask : public QRunnable
+{
+public:
+	StressTask( QSemaphore * started, QSemaphore * go, bool forms ) : m_started( started ), m_go( go ), m_forms( forms ), m_failures( 0 )
+	{
+		setAutoDelete( false );
+	}
+	
+	void run()
+	{
+		m_started->release();
+		m_go->acquire();
+		
+		int iterations = m_forms ? 1000 : boundariesPerThread;
+		for(int i = 0;i < iterations;i++)
+		{
+			if( !m_forms )
+			{
+				m_boundaries.append( SendFormTest::generateBoundary() );
+				continue;
+			}
+			
+			// the first forms of each thread initialize the shared tables at the same time
+			SendForm form( QUrl( "http://127.0.0.1/" ) );
+			form.addField( "name", QString::number( i ) );
+			if( SendFormTest::urlEncodedBody( form ).isEmpty() ) m_failures++;
+			
+			form.forceMultipart();
+			QByteArray body = SendFormTest::body( form );
+			if( !body.startsWith( "--" ) ) m_failures++;
+			
+			if( !SendFormTest::mimeType( "txt" ) ) m_failures++;
+		}
+	}
+	
+	QList< QByteArray > m_boundaries;
+	
+	int failures() const
+	{
+		return m_failures;
+	}
+
+private:
+	QSemaphore * m_started;
+	QSemaphore * m_go;
+	bool m_forms;
+	int m_failures;
+};
+
+////////////////////////////////////////////////////////////
+/// SendForm used from many threads at once, meant to be run under ThreadSanitizer too
+////////////////////////////////////////////////////////////
+class tst_Boundary : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void uniqueAcrossThreads();
+	void concurrentForms();
+
+private:
+	static QList< StressTask * > run( bool forms );
+};
+
+QList< StressTask * > tst_Boundary::run( bool forms )
+{
+	QThreadPool pool;
+	pool.setMaxThreadCount( threadCount );
+	
+	QSemaphore started, go;
+	QList< StressTask * > tasks;
+	for(int i = 0;i < threadCount;i++)
+	{
+		tasks.append( new StressTask( &started, &go, forms ) );
+		pool.start( tasks.last() );
+	}
+	
+	started.acquire( threadCount );
+	go.release( threadCount );
+	pool.waitForDone();
+	
+	return tasks;
+}
+
+void tst_Boundary::uniqueAcrossThreads()
+{
+	QList< StressTask * > tasks = run( false );
+	
+	// the characters a boundary can use without being quoted
+	const QByteArray allowed = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz'()+_,-./:=?";
+	
+	QSet< QByteArray > boundaries;
+	int total = 0;
+	foreach( StressTask * task, tasks )
+	{
+		foreach( const QByteArray & boundary, task->m_boundaries )
+		{
+			QVERIFY( boundary.size() >= 1 && boundary.size() <= 70 );
+			for(int i = 0;i < boundary.size();i++)
+			{
+				QVERIFY2( allowed.contains( boundary[i] ), boundary.constData() );
+			}
+			
+			boundaries.insert( boundary );
+			total++;
+		}
+	}
+	qDeleteAll( tasks );
+	
+	QCOMPARE( total, threadCount * boundariesPerThread );
+	QCOMPARE( boundaries.size(), total );
+}
+
+void tst_Boundary::concurrentForms()
+{
+	QList< StressTask * > tasks = run( true );
+	
+	int failures = 0;
+	foreach( StressTask * task, tasks )
+	{
+		failures += task->failures();
+	}
+	qDeleteAll( tasks );
+	
+	QCOMPARE( failures, 0 );
+}
+
+QTEST_MAIN( tst_Boundary )
+
+#include "tst_boundary.moc"
@@ -0,0 +1,4 @@
+TARGET = tst_compression
+include(../tests.pri)
+
+SOURCES += tst_compression.cpp
@@ -0,0 +1,283 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "CompressedBodyDevice.h"
+#include "HttpSink.h"
+#include "MultipartBodyDevice.h"
+#include "SendForm.h"
+#include "SendFormBatch.h"
+#include "SendFormTest.h"
+
+#include <QFile>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <cstring>
+#include <zlib.h>
+
+////////////////////////////////////////////////////////////
+/// a random-access device whose reads fail from an offset, like a file on a removed disk
+////////////////////////////////////////////////////////////
+class FailingDevice : public QIODevice
+{
+public:
+	FailingDevice( qint64 size, qint64 failAt ) : m_size( size ), m_failAt( failAt ), m_offset( 0 )
+	{
+		open( QIODevice::ReadOnly | QIODevice::Unbuffered );
+	}
+	
+	bool isSequential() const
+	{
+		return false;
+	}
+	
+	qint64 size() const
+	{
+		return m_size;
+	}
+	
+	bool seek( qint64 pos )
+	{
+		m_offset = pos;
+		return QIODevice::seek( pos );
+	}
+
+protected:
+	qint64 readData( char * data, qint64 maxSize )
+	{
+		if( m_offset >= m_failAt )
+		{
+			setErrorString( "Input/output error" );
+			return -1;
+		}
+		
+		qint64 read = qMin( maxSize, m_failAt - m_offset );
+		std::memset( data, 'x', size_t( read ) );
+		m_offset += read;
+		return read;
+	}
+	
+	qint64 writeData( const char *, qint64 )
+	{
+		return -1;
+	}
+
+private:
+	qint64 m_size;
+	qint64 m_failAt;
+	qint64 m_offset;
+};
+
+////////////////////////////////////////////////////////////
+/// compressed bodies checked against the same bodies sent uncompressed
+////////////////////////////////////////////////////////////
+class tst_Compression : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	
+	void identicalBody_data();
+	void identicalBody();
+	
+	void sourceError();
+	void notSentOnError();
+
+private:
+	QTemporaryDir m_dir;
+	QString m_file;
+	
+	static bool inflate( const QByteArray & compressed, QByteArray & out );
+};
+
+void tst_Compression::initTestCase()
+{
+	QVERIFY( m_dir.isValid() );
+	
+	m_file = m_dir.path() + "/data.csv";
+	QFile file( m_file );
+	QVERIFY( file.open( QIODevice::WriteOnly ) );
+	for(int i = 0;i < 50000;i++)
+	{
+		file.write( "2026-10-16," + QByteArray::number( i ) + ",sensor-" + QByteArray::number( i % 17 ) + ",ok\n" );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// inflate a gzip or zlib stream, false if it isn't complete and valid
+////////////////////////////////////////////////////////////
+bool tst_Compression::inflate( const QByteArray & compressed, QByteArray & out )
+{
+	z_stream stream;
+	std::memset( &stream, 0, sizeof( stream ) );
+	
+	// 32 more bits of window detects the gzip and the zlib headers
+	if( inflateInit2( &stream, MAX_WBITS + 32 ) != Z_OK ) return false;
+	
+	stream.next_in = reinterpret_cast< Bytef * >( const_cast< char * >( compressed.constData() ) );
+	stream.avail_in = uInt( compressed.size() );
+	
+	QByteArray chunk( 64 * 1024, Qt::Uninitialized );
+	int result = Z_OK;
+	while( result == Z_OK )
+	{
+		stream.next_out = reinterpret_cast< Bytef * >( chunk.data() );
+		stream.avail_out = uInt( chunk.size() );
+		
+		result = ::inflate( &stream, Z_NO_FLUSH );
+		out.append( chunk.constData(), chunk.size() - int( stream.avail_out ) );
+	}
+	
+	inflateEnd( &stream );
+	return result == Z_STREAM_END;
+}
+
+void tst_Compression::identicalBody_data()
+{
+	QTest::addColumn< bool >( "multipart" );
+	QTest::addColumn< int >( "format" );
+	
+	QTest::newRow( "urlencoded gzip" ) << false << int( SendForm::Gzip );
+	QTest::newRow( "urlencoded deflate" ) << false << int( SendForm::Deflate );
+	QTest::newRow( "multipart gzip" ) << true << int( SendForm::Gzip );
+	QTest::newRow( "multipart deflate" ) << true << int( SendForm::Deflate );
+}
+
+////////////////////////////////////////////////////////////
+/// the server inflates exactly the body the form sends without compression
+////////////////////////////////////////////////////////////
+void tst_Compression::identicalBody()
+{
+	QFETCH( bool, multipart );
+	QFETCH( int, format );
+	
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	
+	SendForm form( sink.url( "/upload" ) );
+	for(int i = 0;i < 200;i++)
+	{
+		form.addField( QString( "field%1" ).arg( i ), QString::fromUtf8( "valeur répétée %1 & encore" ).arg( i % 7 ) );
+	}
+	if( multipart ) form.addFile( "file", m_file );
+	
+	// the same form keeps its boundary, so both bodies are the same before compression
+	QNetworkAccessManager manager;
+	QNetworkReply * reply = form.post( &manager );
+	QVERIFY( reply );
+	QVERIFY( SendFormTest::waitForFinished( reply ) );
+	QCOMPARE( reply->error(), QNetworkReply::NoError );
+	delete reply;
+	
+	form.setBodyCompression( 6, SendForm::Compression( format ) );
+	reply = form.post( &manager );
+	QVERIFY( reply );
+	QVERIFY( SendFormTest::waitForFinished( reply ) );
+	QCOMPARE( reply->error(), QNetworkReply::NoError );
+	delete reply;
+	
+	QCOMPARE( sink.completeCount(), 2 );
+	
+	const HttpSink::Request & plain = sink.request( 0 );
+	const HttpSink::Request & compressed = sink.request( 1 );
+	QCOMPARE( compressed.header( "Content-Encoding" ), QByteArray( format == SendForm::Gzip ? "gzip" : "deflate" ) );
+	QVERIFY( compressed.body.size() < plain.body.size() );
+	
+	QByteArray inflated;
+	QVERIFY( inflate( compressed.body, inflated ) );
+	QCOMPARE( inflated.size(), plain.body.size() );
+	QVERIFY( inflated == plain.body );
+}
+
+////////////////////////////////////////////////////////////
+/// a source failing in the middle makes the compression fail instead of finishing the stream
+////////////////////////////////////////////////////////////
+void tst_Compression::sourceError()
+{
+	FailingDevice failing( 1024 * 1024, 100 * 1024 );
+	
+	MultipartBodyDevice * body = new MultipartBodyDevice;
+	body->appendData( "--boundary\r\n\r\n" );
+	body->appendDevice( &failing, failing.size() );
+	body->appendData( "\r\n--boundary--\r\n" );
+	body->open( QIODevice::ReadOnly );
+	
+	CompressedBodyDevice compressed( body, 6, CompressedBodyDevice::Gzip );
+	body->setParent( &compressed );
+	QVERIFY( compressed.open( QIODevice::ReadOnly ) );
+	
+	QByteArray output;
+	QByteArray chunk( 16 * 1024, Qt::Uninitialized );
+	qint64 read;
+	while( ( read = compressed.read( chunk.data(), chunk.size() ) ) > 0 )
+	{
+		output.append( chunk.constData(), int( read ) );
+	}
+	
+	QCOMPARE( read, qint64( -1 ) );
+	QVERIFY( !compressed.atEnd() );
+	
+	QByteArray inflated;
+	QVERIFY( !inflate( output, inflated ) );
+	QVERIFY( inflated.size() <= 100 * 1024 + 14 );
+}
+
+////////////////////////////////////////////////////////////
+/// a compressed body whose device fails isn't sent, by post() or by a batch
+////////////////////////////////////////////////////////////
+void tst_Compression::notSentOnError()
+{
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	FailingDevice failing( 1024 * 1024, 100 * 1024 );
+	
+	SendForm form( sink.url( "/upload" ) );
+	form.addField( "description", "failing device" );
+	form.addDevice( "file", &failing, "data.bin" );
+	form.setBodyCompression( 6 );
+	
+	QNetworkAccessManager manager;
+	QTest::ignoreMessage( QtWarningMsg, "SendForm: cannot read the body to spool it (Input/output error)" );
+	QVERIFY( !form.post( &manager ) );
+	
+	failing.seek( 0 );
+	
+	SendFormBatch batch( &manager );
+	int notSent = 0;
+	connect( &batch, &SendFormBatch::formNotSent, [&notSent]( const SendForm & ) { notSent++; } );
+	QSignalSpy finished( &batch, SIGNAL( finished() ) );
+	
+	QTest::ignoreMessage( QtWarningMsg, "SendForm: cannot read the body to spool it (Input/output error)" );
+	batch.enqueue( form );
+	
+	QCOMPARE( notSent, 1 );
+	QVERIFY( finished.wait( 1000 ) );
+	QCOMPARE( finished.count(), 1 );
+	QCOMPARE( batch.completedCount(), 1 );
+	QCOMPARE( batch.failedCount(), 1 );
+	QCOMPARE( batch.pendingCount(), 0 );
+	QCOMPARE( sink.connectionCount(), 0 );
+}
+
+QTEST_MAIN( tst_Compression )
+
+#include "tst_compression.moc"
@@ -0,0 +1,4 @@
+TARGET = tst_expectcontinue
+include(../tests.pri)
+
+SOURCES += tst_expectcontinue.cpp
@@ -0,0 +1,153 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "HttpSink.h"
+#include "SendForm.h"
+#include "SendFormTest.h"
+
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QtTest>
+
+////////////////////////////////////////////////////////////
+/// "Expect: 100-continue" against a server rejecting the requests early, or not answering "100 Continue"
+////////////////////////////////////////////////////////////
+class tst_ExpectContinue : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void rejectedBeforeBody();
+	void timeoutFallback();
+	void continueAnswered();
+
+private:
+	static SendForm largeForm( const QUrl & url, int size );
+};
+
+SendForm tst_ExpectContinue::largeForm( const QUrl & url, int size )
+{
+	SendForm form( url );
+	form.addField( "description", "large upload" );
+	form.addData( "file", QByteArray( size, 'x' ), "data.bin" );
+	return form;
+}
+
+////////////////////////////////////////////////////////////
+/// a server answering 413 right after the headers gets (almost) none of the body, and the reply doesn't wait for the timeout
+////////////////////////////////////////////////////////////
+void tst_ExpectContinue::rejectedBeforeBody()
+{
+	const int size = 64 * 1024 * 1024;
+	const int timeout = 10000;
+	
+	HttpSink sink;
+	sink.setRejectEarly( 413 );
+	QVERIFY( sink.listen() );
+	
+	SendForm form = largeForm( sink.url( "/upload" ), size );
+	form.setExpectContinue( true, timeout );
+	
+	QNetworkAccessManager manager;
+	QElapsedTimer timer;
+	timer.start();
+	
+	QNetworkReply * reply = form.post( &manager );
+	QVERIFY( reply );
+	QVERIFY( SendFormTest::waitForFinished( reply, 2 * timeout ) );
+	qint64 elapsed = timer.elapsed();
+	
+	QVERIFY( reply->error() != QNetworkReply::NoError );
+	delete reply;
+	
+	QVERIFY( sink.requestCount() >= 1 );
+	QCOMPARE( sink.request( 0 ).header( "Expect" ), QByteArray( "100-continue" ) );
+	
+	// the body would have been given after the timeout
+	QVERIFY2( elapsed < timeout / 2, qPrintable( QString( "finished after %1 ms" ).arg( elapsed ) ) );
+	QVERIFY2( sink.bodyBytes() < size / 64, qPrintable( QString( "%1 bytes of body received" ).arg( sink.bodyBytes() ) ) );
+}
+
+////////////////////////////////////////////////////////////
+/// without "100 Continue" (hidden by QNetworkAccessManager anyway), the body is sent intact once the timeout has elapsed
+////////////////////////////////////////////////////////////
+void tst_ExpectContinue::timeoutFallback()
+{
+	const int size = 1024 * 1024;
+	const int timeout = 300;
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	SendForm form = largeForm( sink.url( "/upload" ), size );
+	form.setExpectContinue( true, timeout );
+	
+	QNetworkAccessManager manager;
+	QElapsedTimer timer;
+	timer.start();
+	
+	QNetworkReply * reply = form.post( &manager );
+	QVERIFY( reply );
+	QVERIFY( SendFormTest::waitForFinished( reply ) );
+	qint64 elapsed = timer.elapsed();
+	
+	QCOMPARE( reply->error(), QNetworkReply::NoError );
+	delete reply;
+	
+	QCOMPARE( sink.completeCount(), 1 );
+	const HttpSink::Request & request = sink.request( 0 );
+	QCOMPARE( request.header( "Expect" ), QByteArray( "100-continue" ) );
+	QCOMPARE( request.bodySize, request.contentLength );
+	QCOMPARE( request.contentLength, form.plannedSize() );
+	
+	// a little slack for the timer resolution
+	QVERIFY2( elapsed >= timeout - 20, qPrintable( QString( "finished after %1 ms" ).arg( elapsed ) ) );
+}
+
+////////////////////////////////////////////////////////////
+/// a server answering "100 Continue" gets the whole body and answers once after it
+////////////////////////////////////////////////////////////
+void tst_ExpectContinue::continueAnswered()
+{
+	const int size = 1024 * 1024;
+	
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	sink.setSendContinue( true );
+	QVERIFY( sink.listen() );
+	
+	SendForm form = largeForm( sink.url( "/upload" ), size );
+	form.setExpectContinue( true, 300 );
+	
+	QNetworkAccessManager manager;
+	QNetworkReply * reply = form.post( &manager );
+	QVERIFY( reply );
+	QVERIFY( SendFormTest::waitForFinished( reply ) );
+	
+	QCOMPARE( reply->error(), QNetworkReply::NoError );
+	QCOMPARE( reply->attribute( QNetworkRequest::HttpStatusCodeAttribute ).toInt(), 200 );
+	delete reply;
+	
+	QCOMPARE( sink.completeCount(), 1 );
+	QCOMPARE( sink.request( 0 ).body.size(), int( form.plannedSize() ) );
+	QVERIFY( sink.request( 0 ).body.contains( QByteArray( size, 'x' ) ) );
+}
+
+QTEST_MAIN( tst_ExpectContinue )
+
+#include "tst_expectcontinue.moc"
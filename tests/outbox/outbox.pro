@@ -0,0 +1,4 @@
+TARGET = tst_outbox
+include(../tests.pri)
+
+SOURCES += tst_outbox.cpp
@@ -0,0 +1,425 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "HttpSink.h"
+#include "SendForm.h"
+#include "SendFormBatch.h"
+#include "SendFormOutbox.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+////////////////////////////////////////////////////////////
+/// the outbox file after crashes, and the forms kept or removed after a replay
+////////////////////////////////////////////////////////////
+class tst_Outbox : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void init();
+	
+	void replayAll();
+	void tornRecord();
+	void corruptedRecord();
+	void appendAfterCrash();
+	void requeueFailed();
+	void clearKeepsNewRecords();
+	void clearAll();
+	void clearCutByCrash();
+	void optionsKept();
+	void inlineFileTooLarge();
+	void versionOneRecord();
+
+private:
+	QTemporaryDir m_dir;
+	QString m_path;
+	HttpSink * m_sink;
+	
+	bool appendForms( SendFormOutbox & outbox, int first, int count );
+	QStringList replay( SendFormOutbox & outbox, qint64 & end, QList< qint64 > * offsets = 0 );
+	
+	static bool truncate( const QString & path, qint64 size );
+};
+
+void tst_Outbox::init()
+{
+	static int test = 0;
+	m_path = m_dir.path() + QString( "/outbox%1" ).arg( test++ );
+}
+
+bool tst_Outbox::appendForms( SendFormOutbox & outbox, int first, int count )
+{
+	for(int i = first;i < first + count;i++)
+	{
+		SendForm form( m_sink->url( "/outbox" ) );
+		form.addField( "id", QString::number( i ) );
+		if( !outbox.append( form ) ) return false;
+	}
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// replay the outbox to the sink and get the bodies received, sorted
+////////////////////////////////////////////////////////////
+QStringList tst_Outbox::replay( SendFormOutbox & outbox, qint64 & end, QList< qint64 > * offsets )
+{
+	int received = m_sink->completeCount();
+	
+	QNetworkAccessManager manager;
+	SendFormBatch batch( &manager );
+	if( offsets )
+	{
+		connect( &batch, &SendFormBatch::formFinished, [offsets]( QNetworkReply * reply ) { offsets->append( SendFormOutbox::recordOffset( reply ) ); } );
+	}
+	
+	QEventLoop loop;
+	connect( &batch, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+	
+	end = outbox.replay( &batch );
+	if( batch.pendingCount() ) loop.exec();
+	
+	QStringList bodies;
+	for(int i = received;i < m_sink->completeCount();i++)
+	{
+		bodies.append( QString::fromLatin1( m_sink->request( i ).body ) );
+	}
+	
+	bodies.sort();
+	return bodies;
+}
+
+////////////////////////////////////////////////////////////
+/// cut a file, like a crash in the middle of a write
+////////////////////////////////////////////////////////////
+bool tst_Outbox::truncate( const QString & path, qint64 size )
+{
+	QFile file( path );
+	return file.open( QIODevice::ReadWrite ) && file.resize( size );
+}
+
+void tst_Outbox::replayAll()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 3 ) );
+	
+	qint64 end;
+	QList< qint64 > offsets;
+	QCOMPARE( replay( outbox, end, &offsets ), QStringList() << "id=0" << "id=1" << "id=2" );
+	QCOMPARE( end, QFileInfo( m_path ).size() );
+	
+	// each reply gives the offset of its own record
+	std::sort( offsets.begin(), offsets.end() );
+	QCOMPARE( offsets.count(), 3 );
+	QCOMPARE( offsets[0], qint64( 0 ) );
+	QVERIFY( offsets[1] > offsets[0] );
+	QVERIFY( offsets[2] > offsets[1] );
+	QVERIFY( offsets[2] < end );
+}
+
+////////////////////////////////////////////////////////////
+/// the last record cut at every size: the records before it are all replayed, it never is
+////////////////////////////////////////////////////////////
+void tst_Outbox::tornRecord()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 2 ) );
+	qint64 complete = QFileInfo( m_path ).size();
+	QVERIFY( appendForms( outbox, 2, 1 ) );
+	
+	QFile file( m_path );
+	QVERIFY( file.open( QIODevice::ReadOnly ) );
+	QByteArray content = file.readAll();
+	file.close();
+	
+	for(qint64 size = complete;size < content.size();size += 7)
+	{
+		QFile torn( m_path );
+		QVERIFY( torn.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+		QCOMPARE( torn.write( content.constData(), size ), size );
+		torn.close();
+		
+		qint64 end;
+		QCOMPARE( replay( outbox, end ), QStringList() << "id=0" << "id=1" );
+		QCOMPARE( end, size );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// a damaged record in the middle is skipped, the ones after it are still replayed
+////////////////////////////////////////////////////////////
+void tst_Outbox::corruptedRecord()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 1 ) );
+	qint64 second = QFileInfo( m_path ).size();
+	QVERIFY( appendForms( outbox, 1, 2 ) );
+	
+	// one byte of the content of the second record
+	QFile file( m_path );
+	QVERIFY( file.open( QIODevice::ReadWrite ) );
+	QVERIFY( file.seek( second + 20 ) );
+	char byte;
+	QVERIFY( file.getChar( &byte ) );
+	QVERIFY( file.seek( second + 20 ) );
+	QVERIFY( file.putChar( char( byte ^ 0x55 ) ) );
+	file.close();
+	
+	qint64 end;
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=0" << "id=2" );
+}
+
+////////////////////////////////////////////////////////////
+/// the forms appended after a crash are found after the record it cut
+////////////////////////////////////////////////////////////
+void tst_Outbox::appendAfterCrash()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 2 ) );
+	QVERIFY( truncate( m_path, QFileInfo( m_path ).size() - 5 ) );
+	QVERIFY( appendForms( outbox, 2, 2 ) );
+	
+	qint64 end;
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=0" << "id=2" << "id=3" );
+}
+
+////////////////////////////////////////////////////////////
+/// the forms requeued during a replay are kept by clear( end ) and replayed again
+////////////////////////////////////////////////////////////
+void tst_Outbox::requeueFailed()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 3 ) );
+	
+	// the server refuses everything, the failed forms are requeued
+	sink.setStatus( 503 );
+	
+	qint64 end;
+	QList< qint64 > offsets;
+	QCOMPARE( replay( outbox, end, &offsets ).count(), 3 );
+	
+	std::sort( offsets.begin(), offsets.end() );
+	QVERIFY( outbox.requeue( offsets[1] ) );
+	QVERIFY( outbox.requeue( offsets[2] ) );
+	QVERIFY( !outbox.requeue( offsets[1] + 1 ) );
+	QVERIFY( !outbox.requeue( -1 ) );
+	
+	QVERIFY( outbox.clear( end ) );
+	
+	sink.setStatus( 200 );
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=1" << "id=2" );
+}
+
+////////////////////////////////////////////////////////////
+/// the forms appended after the replay has started aren't removed by clear( end )
+////////////////////////////////////////////////////////////
+void tst_Outbox::clearKeepsNewRecords()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 2 ) );
+	
+	QNetworkAccessManager manager;
+	SendFormBatch batch( &manager );
+	QEventLoop loop;
+	connect( &batch, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+	
+	qint64 end = outbox.replay( &batch );
+	QVERIFY( appendForms( outbox, 2, 1 ) );
+	loop.exec();
+	
+	QVERIFY( outbox.clear( end ) );
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=2" );
+}
+
+void tst_Outbox::clearAll()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 2 ) );
+	QVERIFY( outbox.clear() );
+	QCOMPARE( QFileInfo( m_path ).size(), qint64( 0 ) );
+	
+	qint64 end;
+	QCOMPARE( replay( outbox, end ), QStringList() );
+	QCOMPARE( end, qint64( 0 ) );
+}
+
+////////////////////////////////////////////////////////////
+/// a clear() cut by a crash before the copy replaced the outbox (Qt < 5.1)
+////////////////////////////////////////////////////////////
+void tst_Outbox::clearCutByCrash()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	// the copy is being written: the outbox is still complete
+	SendFormOutbox outbox( m_path );
+	QVERIFY( appendForms( outbox, 0, 2 ) );
+	SendFormOutbox copy( m_path + ".new" );
+	QVERIFY( appendForms( copy, 1, 1 ) );
+	QVERIFY( truncate( copy.path(), 10 ) );
+	
+	qint64 end;
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=0" << "id=1" );
+	QVERIFY( !QFile::exists( copy.path() ) );
+	
+	// the outbox has been moved aside: the copy is complete and takes its place
+	QVERIFY( QFile::rename( m_path, m_path + ".old" ) );
+	QVERIFY( appendForms( copy, 1, 1 ) );
+	
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=1" );
+	QVERIFY( !QFile::exists( copy.path() ) );
+	QVERIFY( !QFile::exists( m_path + ".old" ) );
+}
+
+////////////////////////////////////////////////////////////
+/// a file too large for a record isn't read, the outbox is left as it was
+////////////////////////////////////////////////////////////
+void tst_Outbox::inlineFileTooLarge()
+{
+	// sparse, it doesn't take the space
+	QFile large( m_path + ".bin" );
+	QVERIFY( large.open( QIODevice::WriteOnly ) );
+	QVERIFY( large.resize( 256 * 1024 * 1024 + 1 ) );
+	large.close();
+	
+	SendForm form( QUrl( "http://localhost/outbox" ) );
+	form.addFile( "file", large.fileName() );
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( !outbox.append( form, true ) );
+	QVERIFY( outbox.errorString().contains( "too large" ) );
+	QVERIFY( !QFile::exists( m_path ) );
+	
+	QVERIFY( outbox.append( form ) );
+	QVERIFY( large.remove() );
+}
+
+////////////////////////////////////////////////////////////
+/// the digests and "Expect: 100-continue" of a form are still sent after a replay
+////////////////////////////////////////////////////////////
+void tst_Outbox::optionsKept()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	SendForm form( sink.url( "/outbox" ) );
+	form.addData( "file", "content of the file", "file.txt", "text/plain" );
+	form.setPartDigests( SendForm::Md5, SendForm::DigestHeaders );
+	form.setExpectContinue( true, 100 );
+	
+	SendFormOutbox outbox( m_path );
+	QVERIFY( outbox.append( form ) );
+	
+	qint64 end;
+	QCOMPARE( replay( outbox, end ).count(), 1 );
+	
+	const HttpSink::Request & request = sink.request( 0 );
+	QCOMPARE( request.header( "Expect" ), QByteArray( "100-continue" ) );
+	QVERIFY( request.body.contains( "Content-MD5: " + QCryptographicHash::hash( "content of the file", QCryptographicHash::Md5 ).toBase64() ) );
+}
+
+////////////////////////////////////////////////////////////
+/// a record written before the options were saved is still replayed
+////////////////////////////////////////////////////////////
+void tst_Outbox::versionOneRecord()
+{
+	HttpSink sink;
+	sink.setKeepBodies( true );
+	QVERIFY( sink.listen() );
+	m_sink = &sink;
+	
+	QByteArray payload;
+	QDataStream stream( &payload, QIODevice::WriteOnly );
+	stream.setVersion( QDataStream::Qt_4_6 );
+	stream << quint8( 1 ) << sink.url( "/outbox" );
+	stream << quint32( 0 );
+	stream << false << qint32( 0 ) << qint32( SendForm::Gzip );
+	stream << quint32( 1 ) << QByteArray( "id" ) << QByteArray( "old" );
+	stream << quint32( 0 ) << quint32( 0 );
+	
+	QByteArray record( 12, Qt::Uninitialized );
+	uchar * header = reinterpret_cast< uchar * >( record.data() );
+	std::memcpy( header, "SFob", 4 );
+	qToLittleEndian< quint32 >( quint32( payload.size() ), header + 4 );
+	qToLittleEndian< quint32 >( quint32( crc32( 0, reinterpret_cast< const Bytef * >( payload.constData() ), uInt( payload.size() ) ) ), header + 8 );
+	record += payload;
+	
+	QFile file( m_path );
+	QVERIFY( file.open( QIODevice::WriteOnly ) );
+	QCOMPARE( file.write( record ), qint64( record.size() ) );
+	file.close();
+	
+	SendFormOutbox outbox( m_path );
+	qint64 end;
+	QCOMPARE( replay( outbox, end ), QStringList() << "id=old" );
+}
+
+QTEST_MAIN( tst_Outbox )
+
+#include "tst_outbox.moc"
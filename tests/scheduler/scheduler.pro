@@ -0,0 +1,4 @@
+TARGET = tst_scheduler
+include(../tests.pri)
+
+SOURCES += tst_scheduler.cpp
@@ -0,0 +1,195 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "HttpSink.h"
+#include "SendForm.h"
+#include "SendFormTest.h"
+#include "ThrottledBodyDevice.h"
+#include "UploadScheduler.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QtTest>
+
+////////////////////////////////////////////////////////////
+/// the rates given by UploadScheduler, measured where the bytes arrive
+////////////////////////////////////////////////////////////
+class tst_Scheduler : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void deviceRate_data();
+	void deviceRate();
+	
+	void receivedRate_data();
+	void receivedRate();
+	
+	void weightedShare();
+
+private:
+	static void compareRate( double measured, qint64 rate );
+};
+
+void tst_Scheduler::compareRate( double measured, qint64 rate )
+{
+	QVERIFY2( measured > rate * 0.8 && measured < rate * 1.2, qPrintable( QString( "%1 bytes/s measured for %2 bytes/s" ).arg( measured, 0, 'f', 1 ).arg( rate ) ) );
+}
+
+void tst_Scheduler::deviceRate_data()
+{
+	QTest::addColumn< qint64 >( "rate" );
+	
+	// below 100 bytes/s, less than one byte is earned every tick
+	QTest::newRow( "50 B/s" ) << qint64( 50 );
+	QTest::newRow( "1999 B/s" ) << qint64( 1999 );
+	QTest::newRow( "300 kB/s" ) << qint64( 300000 );
+}
+
+////////////////////////////////////////////////////////////
+/// two seconds of data read through a throttled device, the bucket of a new scheduler being empty
+////////////////////////////////////////////////////////////
+void tst_Scheduler::deviceRate()
+{
+	QFETCH( qint64, rate );
+	
+	UploadScheduler scheduler;
+	scheduler.setGlobalRate( rate );
+	
+	qint64 size = 2 * rate;
+	QBuffer * source = new QBuffer;
+	source->setData( QByteArray( int( size ), 'x' ) );
+	source->open( QIODevice::ReadOnly );
+	
+	ThrottledBodyDevice throttled( source, &scheduler, "127.0.0.1", 1 );
+	QVERIFY( throttled.open( QIODevice::ReadOnly ) );
+	QSignalSpy woken( &throttled, SIGNAL( readyRead() ) );
+	
+	QElapsedTimer timer;
+	timer.start();
+	
+	QByteArray chunk( 64 * 1024, Qt::Uninitialized );
+	qint64 total = 0;
+	while( total < size && timer.elapsed() < 10000 )
+	{
+		qint64 read = throttled.read( chunk.data(), chunk.size() );
+		QVERIFY( read >= 0 );
+		total += read;
+		
+		if( read == 0 && woken.isEmpty() ) woken.wait( 100 );
+		woken.clear();
+	}
+	
+	QCOMPARE( total, size );
+	compareRate( size * 1000.0 / timer.elapsed(), rate );
+}
+
+void tst_Scheduler::receivedRate_data()
+{
+	QTest::addColumn< bool >( "host" );
+	
+	QTest::newRow( "global" ) << false;
+	QTest::newRow( "host" ) << true;
+}
+
+////////////////////////////////////////////////////////////
+/// the body of a form arrives at the rate of the scheduler
+////////////////////////////////////////////////////////////
+void tst_Scheduler::receivedRate()
+{
+	QFETCH( bool, host );
+	
+	const qint64 rate = 100000;
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	UploadScheduler scheduler;
+	if( host ) scheduler.setHostRate( sink.url().host(), rate );
+	else scheduler.setGlobalRate( rate );
+	
+	SendForm form( sink.url( "/upload" ) );
+	form.addData( "file", QByteArray( int( 2 * rate ), 'x' ), "data.bin" );
+	form.setUploadScheduler( &scheduler );
+	
+	QNetworkAccessManager manager;
+	QNetworkReply * reply = form.post( &manager );
+	QVERIFY( reply );
+	QVERIFY( SendFormTest::waitForFinished( reply ) );
+	QCOMPARE( reply->error(), QNetworkReply::NoError );
+	delete reply;
+	
+	QCOMPARE( sink.completeCount(), 1 );
+	const HttpSink::Request & request = sink.request( 0 );
+	
+	qint64 duration = request.lastBodyByte - request.firstBodyByte;
+	QVERIFY( duration > 0 );
+	compareRate( request.bodySize * 1000.0 / duration, rate );
+	QCOMPARE( host ? scheduler.bytesSent( sink.url().host() ) : scheduler.bytesSent(), request.bodySize );
+}
+
+////////////////////////////////////////////////////////////
+/// two uploads waiting for the same tokens get them in proportion to their weight
+////////////////////////////////////////////////////////////
+void tst_Scheduler::weightedShare()
+{
+	const qint64 rate = 40000;
+	
+	HttpSink sink;
+	QVERIFY( sink.listen() );
+	
+	UploadScheduler scheduler;
+	scheduler.setGlobalRate( rate );
+	
+	SendForm light( sink.url( "/light" ) );
+	light.addData( "file", QByteArray( int( 4 * rate ), 'x' ), "data.bin" );
+	light.setUploadScheduler( &scheduler, 1 );
+	
+	SendForm heavy( sink.url( "/heavy" ) );
+	heavy.addData( "file", QByteArray( int( 4 * rate ), 'x' ), "data.bin" );
+	heavy.setUploadScheduler( &scheduler, 3 );
+	
+	QNetworkAccessManager manager;
+	QNetworkReply * lightReply = light.post( &manager );
+	QNetworkReply * heavyReply = heavy.post( &manager );
+	QVERIFY( lightReply );
+	QVERIFY( heavyReply );
+	
+	// sampled while both are still sending
+	QEventLoop loop;
+	QTimer::singleShot( 1500, &loop, SLOT( quit() ) );
+	loop.exec();
+	
+	QCOMPARE( sink.requestCount(), 2 );
+	qint64 lightBytes = sink.request( 0 ).path == "/light" ? sink.request( 0 ).bodySize : sink.request( 1 ).bodySize;
+	qint64 heavyBytes = sink.request( 0 ).path == "/heavy" ? sink.request( 0 ).bodySize : sink.request( 1 ).bodySize;
+	
+	QVERIFY( lightBytes > 0 );
+	double ratio = double( heavyBytes ) / lightBytes;
+	QVERIFY2( ratio > 2.0 && ratio < 4.0, qPrintable( QString( "%1 bytes for weight 3, %2 bytes for weight 1" ).arg( heavyBytes ).arg( lightBytes ) ) );
+	
+	delete lightReply;
+	delete heavyReply;
+}
+
+QTEST_MAIN( tst_Scheduler )
+
+#include "tst_scheduler.moc"
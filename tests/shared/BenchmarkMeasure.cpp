@@ -0,0 +1,138 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "BenchmarkMeasure.h"
+
+#include <QtGlobal>
+#include <QAtomicInt>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined( Q_OS_WIN )
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// the sanitizers replace the allocator themselves, the allocations aren't counted then
+#if defined( __SANITIZE_THREAD__ ) || defined( __SANITIZE_ADDRESS__ )
+#define SEND_FORM_SANITIZED
+#elif defined( __has_feature )
+#if __has_feature( thread_sanitizer ) || __has_feature( address_sanitizer )
+#define SEND_FORM_SANITIZED
+#endif
+#endif
+
+static QBasicAtomicInt allocationCount = Q_BASIC_ATOMIC_INITIALIZER( 0 );
+
+#if defined( SEND_FORM_SANITIZED )
+#elif defined( __GLIBC__ )
+// Qt allocates its containers with malloc(), so it is malloc() that is counted
+extern "C"
+{
+	void * __libc_malloc( size_t size );
+	void * __libc_calloc( size_t count, size_t size );
+	void * __libc_realloc( void * pointer, size_t size );
+	
+	void * malloc( size_t size )
+	{
+		allocationCount.fetchAndAddRelaxed( 1 );
+		return __libc_malloc( size );
+	}
+	
+	void * calloc( size_t count, size_t size )
+	{
+		allocationCount.fetchAndAddRelaxed( 1 );
+		return __libc_calloc( count, size );
+	}
+	
+	void * realloc( void * pointer, size_t size )
+	{
+		allocationCount.fetchAndAddRelaxed( 1 );
+		return __libc_realloc( pointer, size );
+	}
+}
+#else
+void * operator new( size_t size )
+{
+	allocationCount.fetchAndAddRelaxed( 1 );
+	
+	void * pointer = std::malloc( size ? size : 1 );
+	if( !pointer ) throw std::bad_alloc();
+	return pointer;
+}
+
+void operator delete( void * pointer ) throw()
+{
+	std::free( pointer );
+}
+#endif
+
+BenchmarkMeasure::BenchmarkMeasure()
+{
+	m_allocations = allocations();
+	m_bytes = 0;
+	m_iterations = 0;
+	m_timer.start();
+}
+
+void BenchmarkMeasure::add( qint64 bytes )
+{
+	m_bytes += bytes;
+	m_iterations++;
+}
+
+void BenchmarkMeasure::report() const
+{
+	qint64 elapsed = m_timer.nsecsElapsed();
+	qint64 iterations = qMax( m_iterations, qint64( 1 ) );
+	
+	double megabytesPerSecond = elapsed ? m_bytes * 1000.0 / elapsed : 0.0;
+	double allocationsPerIteration = allocations() < 0 ? -1.0 : double( allocations() - m_allocations ) / iterations;
+	double peak = peakResidentMemory() / ( 1024.0 * 1024.0 );
+	
+	std::printf( "     %.1f MB/s, %.1f allocations per iteration (-1 when not counted), peak RSS %.1f MiB\n", megabytesPerSecond, allocationsPerIteration, peak );
+	std::fflush( stdout );
+}
+
+qint64 BenchmarkMeasure::allocations()
+{
+#if defined( SEND_FORM_SANITIZED )
+	return -1;
+#else
+	return allocationCount.load();
+#endif
+}
+
+qint64 BenchmarkMeasure::peakResidentMemory()
+{
+#if defined( Q_OS_WIN )
+	PROCESS_MEMORY_COUNTERS counters;
+	if( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) ) return -1;
+	return qint64( counters.PeakWorkingSetSize );
+#else
+	struct rusage usage;
+	if( getrusage( RUSAGE_SELF, &usage ) != 0 ) return -1;
+#if defined( Q_OS_MAC )
+	return qint64( usage.ru_maxrss );
+#else
+	return qint64( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_BENCHMARK_MEASURE
+#define SEND_FORM_BENCHMARK_MEASURE
+
+#include <QElapsedTimer>
+
+////////////////////////////////////////////////////////////
+/// BenchmarkMeasure reports the throughput, the allocations and the peak memory of a benchmark.
+///
+/// It is created before QBENCHMARK, each iteration adds the number of bytes it has processed,
+/// and the figures are printed once the benchmark is over.
+/// The allocations are counted by replacing malloc() with glibc, and operator new elsewhere.
+////////////////////////////////////////////////////////////
+class BenchmarkMeasure
+{
+public:
+	BenchmarkMeasure();
+	
+	////////////////////////////////////////////////////////////
+	/// count one iteration
+	///
+	/// \param bytes : the number of bytes processed by the iteration
+	///
+	////////////////////////////////////////////////////////////
+	void add( qint64 bytes );
+	
+	////////////////////////////////////////////////////////////
+	/// print the throughput in MB/s, the allocations per iteration and the peak resident memory
+	///
+	////////////////////////////////////////////////////////////
+	void report() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of allocations done by the process so far, -1 in the builds with a sanitizer
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 allocations();
+	
+	////////////////////////////////////////////////////////////
+	/// get the peak resident memory of the process, in bytes (-1 if it isn't known)
+	///
+	////////////////////////////////////////////////////////////
+	static qint64 peakResidentMemory();
+
+private:
+	QElapsedTimer m_timer;
+	qint64 m_allocations;
+	qint64 m_bytes;
+	qint64 m_iterations;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "H2Sink.h"
+
+#include <QHostAddress>
+#include <QtEndian>
+
+// what a client sends first on an HTTP/2 connection (RFC 7540, 3.5)
+static const char clientPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const int clientPrefaceSize = 24;
+static const int frameHeaderSize = 9;
+
+// frame types and flags (RFC 7540, 6)
+enum
+{
+	DataFrame = 0x0,
+	HeadersFrame = 0x1,
+	SettingsFrame = 0x4,
+	PingFrame = 0x6,
+	WindowUpdateFrame = 0x8,
+	ContinuationFrame = 0x9
+};
+
+enum
+{
+	EndStreamFlag = 0x1,
+	AckFlag = 0x1,
+	EndHeadersFlag = 0x4
+};
+
+H2Sink::H2Sink( QObject * parent ) : QObject( parent )
+{
+	m_connectionCount = 0;
+	m_requestCount = 0;
+	m_completeCount = 0;
+	m_bodyBytes = 0;
+	
+	connect( &m_server, SIGNAL( newConnection() ), this, SLOT( newConnection() ) );
+}
+
+bool H2Sink::listen()
+{
+	return m_server.listen( QHostAddress::LocalHost );
+}
+
+QUrl H2Sink::url( const QString & path ) const
+{
+	QUrl url;
+	url.setScheme( "http" );
+	url.setHost( "127.0.0.1" );
+	url.setPort( m_server.serverPort() );
+	url.setPath( path );
+	return url;
+}
+
+int H2Sink::connectionCount() const
+{
+	return m_connectionCount;
+}
+
+int H2Sink::requestCount() const
+{
+	return m_requestCount;
+}
+
+int H2Sink::completeCount() const
+{
+	return m_completeCount;
+}
+
+qint64 H2Sink::bodyBytes() const
+{
+	return m_bodyBytes;
+}
+
+void H2Sink::newConnection()
+{
+	while( QTcpSocket * socket = m_server.nextPendingConnection() )
+	{
+		m_connectionCount++;
+		m_connections.insert( socket, Connection() );
+		
+		connect( socket, SIGNAL( readyRead() ), this, SLOT( readyRead() ) );
+		connect( socket, SIGNAL( disconnected() ), this, SLOT( disconnected() ) );
+		
+		// SETTINGS_MAX_CONCURRENT_STREAMS = 100, like most servers
+		QByteArray settings( 6, '\0' );
+		qToBigEndian< quint16 >( 0x3, reinterpret_cast< uchar * >( settings.data() ) );
+		qToBigEndian< quint32 >( 100, reinterpret_cast< uchar * >( settings.data() ) + 2 );
+		socket->write( frame( SettingsFrame, 0, 0, settings ) );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// read the preface, then the frames of a connection one after the other
+////////////////////////////////////////////////////////////
+void H2Sink::readyRead()
+{
+	QTcpSocket * socket = qobject_cast< QTcpSocket * >( sender() );
+	if( !socket || !m_connections.contains( socket ) ) return;
+	
+	Connection & connection = m_connections[socket];
+	connection.buffer += socket->readAll();
+	
+	if( !connection.prefaceRead )
+	{
+		if( connection.buffer.size() < clientPrefaceSize ) return;
+		
+		if( !connection.buffer.startsWith( QByteArray( clientPreface, clientPrefaceSize ) ) )
+		{
+			socket->abort();
+			return;
+		}
+		
+		connection.buffer.remove( 0, clientPrefaceSize );
+		connection.prefaceRead = true;
+	}
+	
+	while( connection.buffer.size() >= frameHeaderSize )
+	{
+		const uchar * header = reinterpret_cast< const uchar * >( connection.buffer.constData() );
+		int length = ( header[0] << 16 ) | ( header[1] << 8 ) | header[2];
+		if( connection.buffer.size() < frameHeaderSize + length ) break;
+		
+		quint8 type = header[3];
+		quint8 flags = header[4];
+		quint32 stream = qFromBigEndian< quint32 >( header + 5 ) & 0x7FFFFFFF;
+		QByteArray payload = connection.buffer.mid( frameHeaderSize, length );
+		connection.buffer.remove( 0, frameHeaderSize + length );
+		
+		handleFrame( socket, connection, type, flags, stream, payload );
+	}
+}
+
+void H2Sink::disconnected()
+{
+	QTcpSocket * socket = qobject_cast< QTcpSocket * >( sender() );
+	if( !socket ) return;
+	
+	m_connections.remove( socket );
+	socket->deleteLater();
+}
+
+void H2Sink::handleFrame( QTcpSocket * socket, Connection & connection, quint8 type, quint8 flags, quint32 stream, const QByteArray & payload )
+{
+	switch( type )
+	{
+	case SettingsFrame:
+		if( !( flags & AckFlag ) ) socket->write( frame( SettingsFrame, AckFlag, 0, QByteArray() ) );
+		break;
+	
+	case PingFrame:
+		if( !( flags & AckFlag ) ) socket->write( frame( PingFrame, AckFlag, 0, payload ) );
+		break;
+	
+	case HeadersFrame:
+	case ContinuationFrame:
+		if( type == HeadersFrame )
+		{
+			m_requestCount++;
+			if( flags & EndStreamFlag ) connection.ended.insert( stream );
+		}
+		
+		// the header block isn't decoded, only its end matters
+		if( !( flags & EndHeadersFlag ) )
+		{
+			connection.openHeaders.insert( stream );
+		}
+		else
+		{
+			connection.openHeaders.remove( stream );
+			if( connection.ended.remove( stream ) ) respond( socket, stream );
+		}
+		break;
+	
+	case DataFrame:
+		m_bodyBytes += payload.size();
+		
+		if( !payload.isEmpty() )
+		{
+			// the window of the connection, and the one of the stream while it can still send
+			QByteArray increment( 4, '\0' );
+			qToBigEndian< quint32 >( quint32( payload.size() ), reinterpret_cast< uchar * >( increment.data() ) );
+			socket->write( frame( WindowUpdateFrame, 0, 0, increment ) );
+			if( !( flags & EndStreamFlag ) ) socket->write( frame( WindowUpdateFrame, 0, stream, increment ) );
+		}
+		
+		if( flags & EndStreamFlag )
+		{
+			if( connection.openHeaders.contains( stream ) ) connection.ended.insert( stream );
+			else respond( socket, stream );
+		}
+		break;
+	
+	default:
+		// PRIORITY, RST_STREAM, GOAWAY, ... don't need an answer
+		break;
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// answer "200" without a body to a request received entirely
+////////////////////////////////////////////////////////////
+void H2Sink::respond( QTcpSocket * socket, quint32 stream )
+{
+	m_completeCount++;
+	
+	// 0x88 is ":status: 200" in the static table of HPACK (RFC 7541, appendix A)
+	socket->write( frame( HeadersFrame, EndHeadersFlag | EndStreamFlag, stream, QByteArray( 1, char( 0x88 ) ) ) );
+}
+
+QByteArray H2Sink::frame( quint8 type, quint8 flags, quint32 stream, const QByteArray & payload )
+{
+	QByteArray bytes( frameHeaderSize, '\0' );
+	uchar * header = reinterpret_cast< uchar * >( bytes.data() );
+	header[0] = uchar( payload.size() >> 16 );
+	header[1] = uchar( payload.size() >> 8 );
+	header[2] = uchar( payload.size() );
+	header[3] = type;
+	header[4] = flags;
+	qToBigEndian< quint32 >( stream, header + 5 );
+	
+	return bytes + payload;
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_H2_SINK
+#define SEND_FORM_H2_SINK
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+
+////////////////////////////////////////////////////////////
+/// H2Sink is an HTTP/2 server without TLS (h2c, prior knowledge) on the loopback interface.
+///
+/// It only knows what the benchmarks need: it reads the frames of the requests without decoding
+/// their headers, gives back the flow control window of the bodies and answers "200" to each
+/// stream once its body has been received.
+////////////////////////////////////////////////////////////
+class H2Sink : public QObject
+{
+	Q_OBJECT
+	
+public:
+	H2Sink( QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// listen on a free port of the loopback interface
+	///
+	////////////////////////////////////////////////////////////
+	bool listen();
+	
+	////////////////////////////////////////////////////////////
+	/// get the url of a path on the sink
+	///
+	////////////////////////////////////////////////////////////
+	QUrl url( const QString & path = QString( "/" ) ) const;
+	
+	int connectionCount() const;
+	int requestCount() const;
+	int completeCount() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body received by all the requests
+	///
+	////////////////////////////////////////////////////////////
+	qint64 bodyBytes() const;
+
+private slots:
+	void newConnection();
+	void readyRead();
+	void disconnected();
+
+private:
+	struct Connection
+	{
+		Connection() : prefaceRead( false ) {}
+		
+		bool prefaceRead;
+		QByteArray buffer;
+		QSet< quint32 > openHeaders;	///< streams whose header block continues in CONTINUATION frames
+		QSet< quint32 > ended;			///< streams whose body has been received, waiting for the end of their headers
+	};
+	
+	void handleFrame( QTcpSocket * socket, Connection & connection, quint8 type, quint8 flags, quint32 stream, const QByteArray & payload );
+	void respond( QTcpSocket * socket, quint32 stream );
+	static QByteArray frame( quint8 type, quint8 flags, quint32 stream, const QByteArray & payload );
+	
+	QTcpServer m_server;
+	QHash< QTcpSocket *, Connection > m_connections;
+	int m_connectionCount;
+	int m_requestCount;
+	int m_completeCount;
+	qint64 m_bodyBytes;
+};
+
+#endif
@@ -0,0 +1,261 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "HttpSink.h"
+
+#include <QHostAddress>
+#include <QTimer>
+
+// the answer to a request and the one to its headers when it expects "100 Continue"
+static const char continueResponse[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+QByteArray HttpSink::Request::header( const QByteArray & name ) const
+{
+	for(int i = 0;i < headers.count();i++)
+	{
+		if( qstricmp( headers[i].first.constData(), name.constData() ) == 0 ) return headers[i].second;
+	}
+	
+	return QByteArray();
+}
+
+HttpSink::HttpSink( QObject * parent ) : QObject( parent )
+{
+	m_connectionCount = 0;
+	m_completeCount = 0;
+	m_keepBodies = false;
+	m_status = 200;
+	m_rejectStatus = 0;
+	m_linger = 200;
+	m_sendContinue = false;
+	
+	connect( &m_server, SIGNAL( newConnection() ), this, SLOT( newConnection() ) );
+}
+
+bool HttpSink::listen()
+{
+	m_clock.start();
+	return m_server.listen( QHostAddress::LocalHost );
+}
+
+QUrl HttpSink::url( const QString & path ) const
+{
+	QUrl url;
+	url.setScheme( "http" );
+	url.setHost( "127.0.0.1" );
+	url.setPort( m_server.serverPort() );
+	url.setPath( path );
+	return url;
+}
+
+void HttpSink::setKeepBodies( bool keep )
+{
+	m_keepBodies = keep;
+}
+
+void HttpSink::setStatus( int status )
+{
+	m_status = status;
+}
+
+void HttpSink::setRejectEarly( int status, int linger )
+{
+	m_rejectStatus = status;
+	m_linger = linger;
+}
+
+void HttpSink::setSendContinue( bool send )
+{
+	m_sendContinue = send;
+}
+
+int HttpSink::connectionCount() const
+{
+	return m_connectionCount;
+}
+
+int HttpSink::requestCount() const
+{
+	return m_requests.count();
+}
+
+int HttpSink::completeCount() const
+{
+	return m_completeCount;
+}
+
+const HttpSink::Request & HttpSink::request( int i ) const
+{
+	return m_requests.at( i );
+}
+
+qint64 HttpSink::bodyBytes() const
+{
+	qint64 bytes = 0;
+	foreach( const Request & request, m_requests )
+	{
+		bytes += request.bodySize;
+	}
+	
+	return bytes;
+}
+
+qint64 HttpSink::elapsed() const
+{
+	return m_clock.elapsed();
+}
+
+void HttpSink::newConnection()
+{
+	while( QTcpSocket * socket = m_server.nextPendingConnection() )
+	{
+		Connection connection;
+		connection.index = m_connectionCount++;
+		m_connections.insert( socket, connection );
+		
+		connect( socket, SIGNAL( readyRead() ), this, SLOT( readyRead() ) );
+		connect( socket, SIGNAL( disconnected() ), this, SLOT( disconnected() ) );
+		
+		emit connectionAccepted();
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// read the headers, then the body, of the requests of a connection one after the other
+////////////////////////////////////////////////////////////
+void HttpSink::readyRead()
+{
+	QTcpSocket * socket = qobject_cast< QTcpSocket * >( sender() );
+	if( !socket || !m_connections.contains( socket ) ) return;
+	
+	Connection & connection = m_connections[socket];
+	connection.buffer += socket->readAll();
+	
+	while( !connection.buffer.isEmpty() )
+	{
+		if( connection.request < 0 )
+		{
+			if( !parseHeaders( socket, connection ) ) break;
+			continue;
+		}
+		
+		Request & request = m_requests[connection.request];
+		qint64 taken = qMin( connection.remaining, qint64( connection.buffer.size() ) );
+		
+		if( request.firstBodyByte < 0 ) request.firstBodyByte = elapsed();
+		request.lastBodyByte = elapsed();
+		request.bodySize += taken;
+		if( m_keepBodies ) request.body.append( connection.buffer.constData(), int( taken ) );
+		
+		connection.buffer.remove( 0, int( taken ) );
+		connection.remaining -= taken;
+		
+		if( connection.remaining == 0 ) finish( socket, connection );
+	}
+}
+
+////////////////////////////////////////////////////////////
+/// close the oldest connection whose request was rejected (they all linger for the same time)
+////////////////////////////////////////////////////////////
+void HttpSink::lingerOver()
+{
+	if( m_lingering.isEmpty() ) return;
+	
+	QPointer< QTcpSocket > socket = m_lingering.dequeue();
+	if( socket ) socket->disconnectFromHost();
+}
+
+void HttpSink::disconnected()
+{
+	QTcpSocket * socket = qobject_cast< QTcpSocket * >( sender() );
+	if( !socket ) return;
+	
+	m_connections.remove( socket );
+	socket->deleteLater();
+}
+
+////////////////////////////////////////////////////////////
+/// parse the headers of the next request, false while they haven't all arrived
+////////////////////////////////////////////////////////////
+bool HttpSink::parseHeaders( QTcpSocket * socket, Connection & connection )
+{
+	int end = connection.buffer.indexOf( "\r\n\r\n" );
+	if( end < 0 ) return false;
+	
+	QList< QByteArray > lines = connection.buffer.left( end ).split( '\n' );
+	connection.buffer.remove( 0, end + 4 );
+	
+	Request request;
+	request.connection = connection.index;
+	
+	QList< QByteArray > requestLine = lines.takeFirst().trimmed().split( ' ' );
+	request.method = requestLine.value( 0 );
+	request.path = requestLine.value( 1 );
+	
+	foreach( const QByteArray & line, lines )
+	{
+		int colon = line.indexOf( ':' );
+		if( colon < 0 ) continue;
+		
+		request.headers.append( qMakePair( line.left( colon ).trimmed(), line.mid( colon + 1 ).trimmed() ) );
+	}
+	
+	request.contentLength = request.header( "Content-Length" ).toLongLong();
+	
+	connection.request = m_requests.count();
+	connection.remaining = request.contentLength;
+	m_requests.append( request );
+	
+	if( m_rejectStatus )
+	{
+		// the rest of the request is still read for a while, so the response isn't lost in a reset of the connection
+		socket->write( response( m_rejectStatus, true ) );
+		connection.rejected = true;
+		m_lingering.enqueue( socket );
+		QTimer::singleShot( m_linger, this, SLOT( lingerOver() ) );
+	}
+	else if( m_sendContinue && qstricmp( request.header( "Expect" ).constData(), "100-continue" ) == 0 )
+	{
+		socket->write( continueResponse );
+	}
+	
+	if( connection.remaining == 0 ) finish( socket, connection );
+	
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+/// the body of a request has been received entirely
+////////////////////////////////////////////////////////////
+void HttpSink::finish( QTcpSocket * socket, Connection & connection )
+{
+	m_requests[connection.request].complete = true;
+	m_completeCount++;
+	connection.request = -1;
+	
+	if( !connection.rejected ) socket->write( response( m_status, false ) );
+	
+	emit requestReceived();
+}
+
+QByteArray HttpSink::response( int status, bool close )
+{
+	QByteArray response = "HTTP/1.1 " + QByteArray::number( status ) + ( status < 300 ? " OK" : " Rejected" ) + "\r\n";
+	response += "Content-Length: 0\r\n";
+	response += close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+	return response;
+}
@@ -0,0 +1,160 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_HTTP_SINK
+#define SEND_FORM_HTTP_SINK
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QQueue>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+
+////////////////////////////////////////////////////////////
+/// HttpSink is an HTTP/1.1 server on the loopback interface that receives the requests of the tests.
+///
+/// It reads the bodies by their Content-Length, answers with an empty response and keeps the connections alive.
+/// It can also answer as soon as the headers have arrived, to reject a request before its body.
+////////////////////////////////////////////////////////////
+class HttpSink : public QObject
+{
+	Q_OBJECT
+	
+public:
+	struct Request
+	{
+		Request() : contentLength( 0 ), bodySize( 0 ), firstBodyByte( -1 ), lastBodyByte( -1 ), complete( false ), connection( -1 ) {}
+		
+		QByteArray method;
+		QByteArray path;
+		QList< QPair< QByteArray, QByteArray > > headers;
+		QByteArray body;		///< empty unless the bodies are kept
+		qint64 contentLength;
+		qint64 bodySize;		///< number of bytes of body received
+		qint64 firstBodyByte;	///< time the first byte of body was received, in milliseconds since listen()
+		qint64 lastBodyByte;	///< time the last byte of body was received, in milliseconds since listen()
+		bool complete;
+		int connection;			///< index of the connection the request was received on
+		
+		QByteArray header( const QByteArray & name ) const;
+	};
+	
+	HttpSink( QObject * parent = 0 );
+	
+	////////////////////////////////////////////////////////////
+	/// listen on a free port of the loopback interface
+	///
+	////////////////////////////////////////////////////////////
+	bool listen();
+	
+	////////////////////////////////////////////////////////////
+	/// get the url of a path on the sink
+	///
+	////////////////////////////////////////////////////////////
+	QUrl url( const QString & path = QString( "/" ) ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// keep the bodies of the requests (only their size is kept by default)
+	///
+	////////////////////////////////////////////////////////////
+	void setKeepBodies( bool keep );
+	
+	////////////////////////////////////////////////////////////
+	/// set the status of the responses (200 by default)
+	///
+	////////////////////////////////////////////////////////////
+	void setStatus( int status );
+	
+	////////////////////////////////////////////////////////////
+	/// answer as soon as the headers have arrived and close the connection
+	///
+	/// \param status : the status of the response, 0 to read the body before answering (the default)
+	/// \param linger : the time the body is still read after the response, before the connection is closed, in milliseconds
+	///
+	////////////////////////////////////////////////////////////
+	void setRejectEarly( int status, int linger = 200 );
+	
+	////////////////////////////////////////////////////////////
+	/// answer "100 Continue" to the requests sent with "Expect: 100-continue"
+	///
+	////////////////////////////////////////////////////////////
+	void setSendContinue( bool send );
+	
+	int connectionCount() const;
+	int requestCount() const;
+	int completeCount() const;
+	const Request & request( int i ) const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the number of bytes of body received by all the requests
+	///
+	////////////////////////////////////////////////////////////
+	qint64 bodyBytes() const;
+	
+	////////////////////////////////////////////////////////////
+	/// get the time since listen(), in milliseconds
+	///
+	////////////////////////////////////////////////////////////
+	qint64 elapsed() const;
+
+signals:
+	void connectionAccepted();
+	void requestReceived();
+
+private slots:
+	void newConnection();
+	void readyRead();
+	void disconnected();
+	void lingerOver();
+
+private:
+	struct Connection
+	{
+		Connection() : index( -1 ), request( -1 ), remaining( 0 ), rejected( false ) {}
+		
+		int index;
+		int request;
+		qint64 remaining;
+		bool rejected;
+		QByteArray buffer;
+	};
+	
+	bool parseHeaders( QTcpSocket * socket, Connection & connection );
+	void finish( QTcpSocket * socket, Connection & connection );
+	static QByteArray response( int status, bool close );
+	
+	QTcpServer m_server;
+	QElapsedTimer m_clock;
+	QHash< QTcpSocket *, Connection > m_connections;
+	QList< Request > m_requests;
+	QQueue< QPointer< QTcpSocket > > m_lingering;
+	int m_connectionCount;
+	int m_completeCount;
+	bool m_keepBodies;
+	int m_status;
+	int m_rejectStatus;
+	int m_linger;
+	bool m_sendContinue;
+};
+
+#endif
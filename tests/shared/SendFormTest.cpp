@@ -0,0 +1,78 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#include "SendFormTest.h"
+
+#include <QEventLoop>
+#include <QTimer>
+
+QByteArray SendFormTest::generateBoundary()
+{
+	return SendForm::generateBoundary();
+}
+
+const char * SendFormTest::mimeType( const QString & suffix )
+{
+	return SendForm::mimeType( suffix );
+}
+
+QByteArray SendFormTest::urlEncodedBody( const SendForm & form, bool cached )
+{
+	if( !cached ) form.m_urlEncodedCache.clear();
+	
+	return form.urlEncodedBody();
+}
+
+QIODevice * SendFormTest::createBody( SendForm & form, qint64 & length )
+{
+	return form.prepareBody( length, 0 );
+}
+
+QByteArray SendFormTest::body( SendForm & form )
+{
+	qint64 length;
+	QIODevice * body = createBody( form, length );
+	if( !body ) return QByteArray();
+	
+	QByteArray data;
+	QByteArray chunk( 64 * 1024, Qt::Uninitialized );
+	for(;;)
+	{
+		qint64 read = body->read( chunk.data(), chunk.size() );
+		if( read <= 0 ) break;
+		
+		data.append( chunk.constData(), int( read ) );
+	}
+	
+	delete body;
+	return data;
+}
+
+bool SendFormTest::waitForFinished( QNetworkReply * reply, int timeout )
+{
+	if( reply->isFinished() ) return true;
+	
+	QEventLoop loop;
+	QTimer timer;
+	timer.setSingleShot( true );
+	QObject::connect( reply, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+	QObject::connect( &timer, SIGNAL( timeout() ), &loop, SLOT( quit() ) );
+	timer.start( timeout );
+	loop.exec();
+	
+	return reply->isFinished();
+}
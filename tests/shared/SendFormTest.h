@@ -0,0 +1,83 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+#ifndef SEND_FORM_TEST
+#define SEND_FORM_TEST
+
+#include "SendForm.h"
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QNetworkReply>
+#include <QString>
+
+////////////////////////////////////////////////////////////
+/// SendFormTest gives the tests and the benchmarks access to the internals of SendForm.
+////////////////////////////////////////////////////////////
+class SendFormTest
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// generate a boundary like the one of a new form
+	///
+	////////////////////////////////////////////////////////////
+	static QByteArray generateBoundary();
+	
+	////////////////////////////////////////////////////////////
+	/// find the content type of a suffix in the table of the forms
+	///
+	/// \return the content type, or 0 if the suffix isn't known
+	///
+	////////////////////////////////////////////////////////////
+	static const char * mimeType( const QString & suffix );
+	
+	////////////////////////////////////////////////////////////
+	/// encode the urlencoded body of a form
+	///
+	/// \param form : the form
+	/// \param cached : false to forget the body encoded by the previous calls first
+	///
+	////////////////////////////////////////////////////////////
+	static QByteArray urlEncodedBody( const SendForm & form, bool cached = false );
+	
+	////////////////////////////////////////////////////////////
+	/// create the body that post() would send
+	///
+	/// \param form : the form
+	/// \param length : receives the length of the body, -1 if it isn't known
+	///
+	/// \return the opened body, the caller takes its ownership, or 0 if it can't be read
+	///
+	////////////////////////////////////////////////////////////
+	static QIODevice * createBody( SendForm & form, qint64 & length );
+	
+	////////////////////////////////////////////////////////////
+	/// read the whole body that post() would send
+	///
+	////////////////////////////////////////////////////////////
+	static QByteArray body( SendForm & form );
+	
+	////////////////////////////////////////////////////////////
+	/// run the event loop until a reply has finished
+	///
+	/// \return false if the reply hasn't finished before the timeout
+	///
+	////////////////////////////////////////////////////////////
+	static bool waitForFinished( QNetworkReply * reply, int timeout = 10000 );
+};
+
+#endif
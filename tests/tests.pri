@@ -0,0 +1,18 @@
+# common settings of the tests, each one is built with the sources of the library
+include(../SendForm.pri)
+
+lessThan(QT_MAJOR_VERSION, 5): error("the tests need Qt 5 or later")
+
+QT = core network testlib
+CONFIG += testcase console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/shared
+DEPENDPATH += $$PWD/shared
+
+SOURCES += $$PWD/shared/H2Sink.cpp \
+	$$PWD/shared/HttpSink.cpp \
+	$$PWD/shared/SendFormTest.cpp
+HEADERS += $$PWD/shared/H2Sink.h \
+	$$PWD/shared/HttpSink.h \
+	$$PWD/shared/SendFormTest.h
@@ -0,0 +1,17 @@
+# tests and benchmarks of the library, built with its sources
+#
+#   qmake tests.pro && make && make check
+#
+# the thread safety tests are also meant to be run under ThreadSanitizer:
+#
+#   qmake CONFIG+=sanitizer CONFIG+=sanitize_thread tests.pro
+#
+# the large multipart benchmark sends a sparse file of SENDFORM_BENCH_LARGE_MB MiB (2048 by default, 0 to skip it)
+TEMPLATE = subdirs
+SUBDIRS = bench \
+	boundary \
+	compression \
+	expectcontinue \
+	outbox \
+	scheduler \
+	urlencoder
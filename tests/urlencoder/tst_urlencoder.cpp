@@ -0,0 +1,169 @@
+/******************************************************************************
+* Copyright (C) 2010, Roper Alexander
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+******************************************************************************/
+// a second copy of the encoder without SIMD, named ScalarFormUrlEncoder, to compare with the one of the library
+#define SEND_FORM_NO_SIMD
+#define FormUrlEncoder ScalarFormUrlEncoder
+#include "../../FormUrlEncoder.cpp"
+#undef FormUrlEncoder
+#undef SEND_FORM_URL_ENCODER
+#include "FormUrlEncoder.h"
+
+#include <QtTest>
+
+////////////////////////////////////////////////////////////
+/// the SIMD and scalar paths of FormUrlEncoder checked against each other and a reference
+////////////////////////////////////////////////////////////
+class tst_UrlEncoder : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void samePaths_data();
+	void samePaths();
+	
+	void everyPosition_data();
+	void everyPosition();
+
+private:
+	static QByteArray reference( const QByteArray & data );
+	static QByteArray encode( const QByteArray & data, bool scalar );
+};
+
+////////////////////////////////////////////////////////////
+/// encode one byte at a time, as described in the header of FormUrlEncoder
+////////////////////////////////////////////////////////////
+QByteArray tst_UrlEncoder::reference( const QByteArray & data )
+{
+	QByteArray encoded;
+	
+	for(int i = 0;i < data.size();i++)
+	{
+		uchar c = uchar( data[i] );
+		
+		if( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '-' || c == '.' || c == '_' || c == '*' )
+		{
+			encoded += char( c );
+		}
+		else if( c == ' ' )
+		{
+			encoded += '+';
+		}
+		else
+		{
+			encoded += '%';
+			encoded += QByteArray::number( c, 16 ).toUpper().rightJustified( 2, '0' );
+		}
+	}
+	
+	return encoded;
+}
+
+QByteArray tst_UrlEncoder::encode( const QByteArray & data, bool scalar )
+{
+	int length = scalar ? ScalarFormUrlEncoder::encodedLength( data.constData(), data.size() ) : FormUrlEncoder::encodedLength( data.constData(), data.size() );
+	
+	// one more byte to catch a write past the computed length
+	QByteArray encoded( length + 1, '#' );
+	char * end = scalar ? ScalarFormUrlEncoder::encode( data.constData(), data.size(), encoded.data() ) : FormUrlEncoder::encode( data.constData(), data.size(), encoded.data() );
+	
+	if( end - encoded.constData() != length || encoded[length] != '#' ) return QByteArray( "length mismatch" );
+	
+	encoded.chop( 1 );
+	return encoded;
+}
+
+void tst_UrlEncoder::samePaths_data()
+{
+	QTest::addColumn< QByteArray >( "data" );
+	
+	QByteArray high;
+	for(int c = 0x80;c < 0x100;c++) high += char( c );
+	
+	QByteArray all;
+	for(int c = 0;c < 0x100;c++) all += char( c );
+	
+	QTest::newRow( "empty" ) << QByteArray();
+	QTest::newRow( "ampersand" ) << QByteArray( "a&b&&c&" );
+	QTest::newRow( "equal" ) << QByteArray( "=key=value==" );
+	QTest::newRow( "plus" ) << QByteArray( "1+1+2" );
+	QTest::newRow( "space" ) << QByteArray( " two  spaces " );
+	QTest::newRow( "high bytes" ) << high;
+	QTest::newRow( "all bytes" ) << all;
+	QTest::newRow( "utf-8" ) << QString::fromUtf8( "élève à l'été ✓ 😀" ).toUtf8();
+	QTest::newRow( "15 safe" ) << QByteArray( 15, 'a' );
+	QTest::newRow( "16 safe" ) << QByteArray( 16, 'a' );
+	QTest::newRow( "17 safe" ) << QByteArray( 17, 'a' );
+	QTest::newRow( "15 mixed" ) << QByteArray( "abc&def=ghi+jk " );
+	QTest::newRow( "16 mixed" ) << QByteArray( "abc&def=ghi+jkl " );
+	QTest::newRow( "17 mixed" ) << QByteArray( "abc&def=ghi+jklm " );
+	QTest::newRow( "16 safe then 1" ) << QByteArray( "0123456789abcdef&" );
+	QTest::newRow( "range limits" ) << QByteArray( "/09:@AZ[`az{-._*~!" );
+}
+
+void tst_UrlEncoder::samePaths()
+{
+	QFETCH( QByteArray, data );
+	
+	QByteArray expected = reference( data );
+	QCOMPARE( encode( data, true ), expected );
+	QCOMPARE( encode( data, false ), expected );
+}
+
+void tst_UrlEncoder::everyPosition_data()
+{
+	QTest::addColumn< char >( "special" );
+	
+	QTest::newRow( "&" ) << '&';
+	QTest::newRow( "=" ) << '=';
+	QTest::newRow( "+" ) << '+';
+	QTest::newRow( "space" ) << ' ';
+	QTest::newRow( "0x80" ) << char( 0x80 );
+	QTest::newRow( "0xC3" ) << char( 0xC3 );
+	QTest::newRow( "0xFF" ) << char( 0xFF );
+}
+
+////////////////////////////////////////////////////////////
+/// a byte to encode at each position of inputs around the 16 bytes blocks
+////////////////////////////////////////////////////////////
+void tst_UrlEncoder::everyPosition()
+{
+	QFETCH( char, special );
+	
+	for(int size = 1;size <= 49;size++)
+	{
+		for(int position = 0;position < size;position++)
+		{
+			QByteArray data( size, 'x' );
+			data[position] = special;
+			
+			QByteArray expected = reference( data );
+			QByteArray scalar = encode( data, true );
+			QByteArray simd = encode( data, false );
+			
+			if( scalar != expected || simd != expected )
+			{
+				QFAIL( qPrintable( QString( "size %1, position %2: expected %3, scalar %4, simd %5" ).arg( size ).arg( position )
+					.arg( QString::fromLatin1( expected ) ).arg( QString::fromLatin1( scalar ) ).arg( QString::fromLatin1( simd ) ) ) );
+			}
+		}
+	}
+}
+
+QTEST_MAIN( tst_UrlEncoder )
+
+#include "tst_urlencoder.moc"
@@ -0,0 +1,4 @@
+TARGET = tst_urlencoder
+include(../tests.pri)
+
+SOURCES += tst_urlencoder.cpp